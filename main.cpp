@@ -16,82 +16,2106 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <string_view>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <charconv>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+#include <filesystem>
+#include <queue>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <exception>
+#include <memory_resource>
+#include <numeric>
+#include <atomic>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // ==========================================
 // 1. Data Structures & Enums
 // ==========================================
 
-enum class OrderBookType { bid, ask, unknown, asksale, bidsale };
+enum class OrderBookType : uint8_t { bid, ask, unknown, asksale, bidsale };
 
+// Microseconds since the Unix epoch (UTC)
+using Timestamp = int64_t;
+
+using ProductId = uint16_t;
+using CurrencyId = uint32_t;
+
+// Process-wide symbol table interning products ("ETH/BTC") and currencies
+// ("ETH") into small dense ids. A product's base and quote currencies are
+// resolved once, when it is first interned. Interning is thread-safe.
+// Lookups by id take no lock and must not race with interning a new symbol.
+class Symbols {
+public:
+    static constexpr CurrencyId noCurrency = UINT32_MAX;
+
+    static ProductId product(std::string_view name) {
+        // parsers see long runs of the same product, so remember the last hit
+        thread_local std::string lastName;
+        thread_local ProductId lastId = 0;
+        if (!lastName.empty() && name == lastName) return lastId;
+        Table& t = table();
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto it = t.productIds.find(name);
+        if (it == t.productIds.end()) {
+            if (t.products.size() > std::numeric_limits<ProductId>::max()) {
+                throw std::runtime_error("too many products");
+            }
+            ProductInfo info{std::string(name), noCurrency, noCurrency};
+            size_t slash = name.find('/');
+            if (slash != std::string_view::npos && slash > 0 && slash + 1 < name.size() &&
+                name.find('/', slash + 1) == std::string_view::npos) {
+                info.base = currencyLocked(t, name.substr(0, slash));
+                info.quote = currencyLocked(t, name.substr(slash + 1));
+            }
+            it = t.productIds.emplace(info.name, static_cast<ProductId>(t.products.size())).first;
+            t.products.push_back(std::move(info));
+        }
+        lastName = name;
+        lastId = it->second;
+        return lastId;
+    }
+
+    static CurrencyId currency(std::string_view name) {
+        Table& t = table();
+        std::lock_guard<std::mutex> lock(t.mutex);
+        return currencyLocked(t, name);
+    }
+
+    static const std::string& productName(ProductId id) { return table().products[id].name; }
+    static const std::string& currencyName(CurrencyId id) { return table().currencies[id]; }
+
+    // True for "BASE/QUOTE" products, the only ones that can be traded
+    static bool isPair(ProductId id) { return table().products[id].base != noCurrency; }
+    static CurrencyId base(ProductId id) { return table().products[id].base; }
+    static CurrencyId quote(ProductId id) { return table().products[id].quote; }
+
+private:
+    struct ProductInfo {
+        std::string name;
+        CurrencyId base;
+        CurrencyId quote;
+    };
+
+    struct Table {
+        std::mutex mutex;
+        std::deque<ProductInfo> products; // deque: entries never move
+        std::deque<std::string> currencies;
+        std::map<std::string, ProductId, std::less<>> productIds;
+        std::map<std::string, CurrencyId, std::less<>> currencyIds;
+    };
+
+    static Table& table() {
+        static Table t;
+        return t;
+    }
+
+    static CurrencyId currencyLocked(Table& t, std::string_view name) {
+        auto it = t.currencyIds.find(name);
+        if (it == t.currencyIds.end()) {
+            it = t.currencyIds.emplace(std::string(name), static_cast<CurrencyId>(t.currencies.size())).first;
+            t.currencies.emplace_back(name);
+        }
+        return it->second;
+    }
+};
+
+using AccountId = uint32_t;
+
+// Registry issuing compact ids for trading accounts. Id 0 is reserved for
+// rows replayed from a dataset, so they need no per-order name.
+class Accounts {
+public:
+    static constexpr AccountId dataset = 0;
+
+    static AccountId id(std::string_view name) {
+        Registry& r = registry();
+        auto it = r.ids.find(name);
+        if (it == r.ids.end()) {
+            it = r.ids.emplace(std::string(name), static_cast<AccountId>(r.names.size())).first;
+            r.names.emplace_back(name);
+        }
+        return it->second;
+    }
+
+    static const std::string& name(AccountId id) { return registry().names[id]; }
+
+private:
+    struct Registry {
+        std::vector<std::string> names{"dataset"};
+        std::map<std::string, AccountId, std::less<>> ids{{"dataset", dataset}};
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+};
+
+// Fixed-point decimal held as an integer count of 10^-8 units, the finest
+// step the feeds quote. Fills compare and subtract exactly, so matching
+// leaves no floating-point dust. The tag keeps prices and quantities apart.
+template <typename Tag>
+class FixedPoint {
+public:
+    static constexpr int kScale = 8;
+    static constexpr int64_t kUnitsPerWhole = 100000000;
+
+    constexpr FixedPoint() : value(0) {}
+
+    static constexpr FixedPoint fromUnits(int64_t units) {
+        FixedPoint f;
+        f.value = units;
+        return f;
+    }
+
+    static constexpr FixedPoint whole(int64_t n) { return fromUnits(n * kUnitsPerWhole); }
+
+    constexpr int64_t units() const { return value; }
+    double toDouble() const { return static_cast<double>(value) / kUnitsPerWhole; }
+
+    constexpr bool operator==(FixedPoint o) const { return value == o.value; }
+    constexpr bool operator!=(FixedPoint o) const { return value != o.value; }
+    constexpr bool operator<(FixedPoint o) const { return value < o.value; }
+    constexpr bool operator<=(FixedPoint o) const { return value <= o.value; }
+    constexpr bool operator>(FixedPoint o) const { return value > o.value; }
+    constexpr bool operator>=(FixedPoint o) const { return value >= o.value; }
+
+    constexpr FixedPoint operator+(FixedPoint o) const { return fromUnits(value + o.value); }
+    constexpr FixedPoint operator-(FixedPoint o) const { return fromUnits(value - o.value); }
+    FixedPoint& operator+=(FixedPoint o) { value += o.value; return *this; }
+    FixedPoint& operator-=(FixedPoint o) { value -= o.value; return *this; }
+
+    friend std::ostream& operator<<(std::ostream& os, FixedPoint f) { return os << f.toDouble(); }
+
+private:
+    int64_t value;
+};
+
+using Price = FixedPoint<struct PriceTag>;
+using Quantity = FixedPoint<struct QuantityTag>;
+
+// Value of amount at price in the quote currency, rounded down to a unit.
+// The product is formed in 128 bits so it cannot overflow.
+inline Quantity notional(Price price, Quantity amount) {
+    __int128 units = static_cast<__int128>(price.units()) * amount.units() / Price::kUnitsPerWhole;
+    return Quantity::fromUnits(static_cast<int64_t>(units));
+}
+
+// Tick and lot size of a product: the coarsest power-of-ten steps, up to one
+// whole, that every price and amount seen for it is a multiple of.
+struct ProductScale {
+    Price tick = Price::whole(1);
+    Quantity lot = Quantity::whole(1);
+
+    void observe(Price price, Quantity amount) {
+        while (price.units() % tick.units() != 0) tick = Price::fromUnits(tick.units() / 10);
+        while (amount.units() % lot.units() != 0) lot = Quantity::fromUnits(lot.units() / 10);
+    }
+};
+
+// One order as a packed 32-byte record with no owned memory, so rows can be
+// memcpy'd and four of them fill a cache line. Names live in Symbols and
+// Accounts and are only looked up at the I/O edges.
 class OrderBookEntry {
 public:
-    double price;
-    double amount;
-    std::string timestamp;
-    std::string product;
-    OrderBookType orderType;
-    std::string username;
+    Price price;
+    Quantity amount;
+    Timestamp timestamp;
+    AccountId account;
+    ProductId product;
+    OrderBookType orderType;
+    uint8_t flags = 0; // per-order state bits, zero for dataset rows
+
+    OrderBookEntry(Price _price, Quantity _amount, Timestamp _timestamp, 
+                   ProductId _product, OrderBookType _orderType, AccountId _account = Accounts::dataset)
+    : price(_price), amount(_amount), timestamp(_timestamp), 
+      account(_account), product(_product), orderType(_orderType) {}
+
+    static OrderBookType stringToOrderBookType(std::string_view s) {
+        if (s == "ask") return OrderBookType::ask;
+        if (s == "bid") return OrderBookType::bid;
+        return OrderBookType::unknown;
+    }
+
+    static bool compareByTimestamp(const OrderBookEntry& e1, const OrderBookEntry& e2) {
+        return e1.timestamp < e2.timestamp;
+    }
+    
+    static bool compareByPriceAsc(const OrderBookEntry& e1, const OrderBookEntry& e2) {
+        return e1.price < e2.price;
+    }
+
+    static bool compareByPriceDesc(const OrderBookEntry& e1, const OrderBookEntry& e2) {
+        return e1.price > e2.price;
+    }
+};
+
+static_assert(sizeof(OrderBookEntry) == 32, "OrderBookEntry must stay a 32-byte record");
+static_assert(std::is_trivially_copyable<OrderBookEntry>::value, "OrderBookEntry must stay memcpy-able");
+
+// Allocator returning storage aligned to a cache line, so packed rows never
+// straddle two lines.
+template <typename T, size_t Align = 64>
+class CacheAlignedAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = CacheAlignedAllocator<U, Align>; };
+
+    CacheAlignedAllocator() = default;
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U, Align>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CacheAlignedAllocator<U, Align>&) const { return false; }
+};
+
+// Optional transparent huge page backing for large arrays. Once enabled,
+// allocations of at least one 2 MB page are mapped on a 2 MB boundary and
+// advised MADV_HUGEPAGE, so scans over them take fewer TLB misses. Smaller
+// allocations, and all of them while disabled, come from the heap. Where
+// THP is off the advice is ignored and the mappings use normal pages.
+// It can only be enabled before the first allocation asks, so memory is
+// always released the way it was allocated.
+class HugePages {
+public:
+    static constexpr size_t kPageSize = 2 << 20;
+
+    static void enable() {
+        if (askedFlag()) throw std::runtime_error("huge pages must be enabled before anything is allocated");
+        enabledFlag() = true;
+    }
+    static bool enabled() { return enabledFlag(); }
+
+    static bool wanted(size_t bytes) {
+        askedFlag() = true;
+        return enabled() && bytes >= kPageSize;
+    }
+
+    static void* allocate(size_t bytes) {
+        size_t length = roundUp(bytes);
+        // map one page extra so the start can be moved to a page boundary
+        void* raw = ::mmap(nullptr, length + kPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        char* begin = static_cast<char*>(raw);
+        char* start = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + kPageSize - 1) & ~(kPageSize - 1));
+        if (start > begin) ::munmap(begin, start - begin);
+        if (begin + kPageSize > start) ::munmap(start + length, begin + kPageSize - start);
+        ::madvise(start, length, MADV_HUGEPAGE); // EINVAL without THP support; normal pages then
+        mappedBytes() += length;
+        return start;
+    }
+
+    static void release(void* p, size_t bytes) {
+        ::munmap(p, roundUp(bytes));
+        mappedBytes() -= roundUp(bytes);
+    }
+
+    // Bytes currently mapped through allocate()
+    static size_t mapped() { return mappedBytes(); }
+
+    // Anonymous memory of this process the kernel has backed with huge
+    // pages, summed from AnonHugePages in /proc/self/smaps_rollup (or smaps)
+    static size_t backed() {
+        for (const char* path : {"/proc/self/smaps_rollup", "/proc/self/smaps"}) {
+            std::ifstream in(path);
+            if (!in) continue;
+            size_t kb = 0;
+            std::string line;
+            while (std::getline(in, line)) {
+                if (line.compare(0, 14, "AnonHugePages:") != 0) continue;
+                const char* p = line.data() + 14;
+                const char* end = line.data() + line.size();
+                while (p < end && *p == ' ') ++p;
+                size_t value = 0;
+                if (std::from_chars(p, end, value).ec == std::errc()) kb += value;
+            }
+            return kb << 10;
+        }
+        return 0;
+    }
+
+    // The kernel's THP setting ("always", "madvise" or "never"), or
+    // "unavailable" if it has none
+    static std::string mode() {
+        std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string line;
+        if (!std::getline(in, line)) return "unavailable";
+        size_t open = line.find('['), close = line.find(']');
+        if (open == std::string::npos || close < open) return "unavailable";
+        return line.substr(open + 1, close - open - 1);
+    }
+
+private:
+    static size_t roundUp(size_t bytes) { return (bytes + kPageSize - 1) & ~(kPageSize - 1); }
+
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    static std::atomic<bool>& askedFlag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    static std::atomic<size_t>& mappedBytes() {
+        static std::atomic<size_t> bytes{0};
+        return bytes;
+    }
+};
+
+// Standard allocator that places large arrays on huge pages when HugePages
+// is enabled and uses the heap otherwise.
+template <typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (HugePages::wanted(n * sizeof(T))) return static_cast<T*>(HugePages::allocate(n * sizeof(T)));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (HugePages::wanted(n * sizeof(T))) HugePages::release(p, n * sizeof(T));
+        else std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+// One column of the order store
+template <typename T>
+using Column = std::vector<T, HugePageAllocator<T>>;
+
+// Rows of orders as they move between loaders, the stream and the matcher
+using OrderRows = std::vector<OrderBookEntry, CacheAlignedAllocator<OrderBookEntry>>;
+
+// Bump allocator for the temporaries of one time step. Deallocation is a
+// no-op; reset() rewinds the arena and keeps its memory, merging the blocks
+// into one, so once it has grown to the busiest step later steps allocate
+// nothing from the heap. Allocations are cache-line aligned.
+class StepArena : public std::pmr::memory_resource {
+public:
+    StepArena() = default;
+    StepArena(const StepArena&) = delete;
+    StepArena& operator=(const StepArena&) = delete;
+
+    ~StepArena() {
+        for (Block& b : blocks) freeBlock(b);
+    }
+
+    // Invalidates everything allocated since the last reset.
+    void reset() {
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (Block& b : blocks) {
+                total += b.size;
+                freeBlock(b);
+            }
+            blocks.clear();
+            addBlock(total);
+        }
+        current = 0;
+        offset = 0;
+    }
+
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block& b : blocks) total += b.size;
+        return total;
+    }
+
+private:
+    static constexpr size_t kAlign = 64;
+    static constexpr size_t kMinBlock = 64 << 10;
+
+    struct Block {
+        char* data;
+        size_t size;
+        bool huge; // mapped by HugePages rather than taken from the heap
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0; // block being carved
+    size_t offset = 0;  // first free byte in it
+
+    void addBlock(size_t size) {
+        bool huge = HugePages::wanted(size);
+        char* data = huge ? static_cast<char*>(HugePages::allocate(size))
+                          : static_cast<char*>(::operator new(size, std::align_val_t(kAlign)));
+        blocks.push_back({data, size, huge});
+    }
+
+    static void freeBlock(Block& b) {
+        if (b.huge) HugePages::release(b.data, b.size);
+        else ::operator delete(b.data, std::align_val_t(kAlign));
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        alignment = std::max(alignment, kAlign);
+        for (;;) {
+            if (current < blocks.size()) {
+                size_t start = (offset + alignment - 1) & ~(alignment - 1);
+                if (start <= blocks[current].size && bytes <= blocks[current].size - start) {
+                    offset = start + bytes;
+                    return blocks[current].data + start;
+                }
+                if (current + 1 < blocks.size()) {
+                    ++current;
+                    offset = 0;
+                    continue;
+                }
+            }
+            addBlock(std::max({kMinBlock, bytes + alignment, blocks.empty() ? 0 : 2 * blocks.back().size}));
+            current = blocks.size() - 1;
+            offset = 0;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Order book rows stored column by column, so a scan reads only the fields
+// it tests. Rows are kept in timestamp order, and a slice table maps each
+// distinct timestamp to the contiguous run of rows carrying it. Within a
+// slice rows are grouped by product, then side, in arrival order, so every
+// (timestamp, product, side) owns a contiguous range too.
+class OrderStore {
+public:
+    Column<Price> price;
+    Column<Quantity> amount;
+    Column<Timestamp> timestamp;
+    Column<ProductId> product;
+    Column<OrderBookType> orderType;
+    Column<AccountId> account;
+
+    // Rows [begin, end) of one time slice
+    struct Slice {
+        size_t begin;
+        size_t end;
+    };
+
+    size_t size() const { return timestamp.size(); }
+    bool empty() const { return timestamp.empty(); }
+    size_t sliceCount() const { return sliceTimes.size(); }
+
+    // Calendar of the distinct timestamps in the store, ascending
+    const Column<Timestamp>& times() const { return sliceTimes; }
+
+    // The rows stamped t, or an empty slice if there are none
+    Slice slice(Timestamp t) const {
+        auto it = std::lower_bound(sliceTimes.begin(), sliceTimes.end(), t);
+        if (it == sliceTimes.end() || *it != t) return Slice{0, 0};
+        return sliceAt(it - sliceTimes.begin());
+    }
+
+    // Number of rows stamped before t
+    size_t rowsBefore(Timestamp t) const {
+        size_t k = std::lower_bound(sliceTimes.begin(), sliceTimes.end(), t) - sliceTimes.begin();
+        return k < sliceStarts.size() ? sliceStarts[k] : size();
+    }
+
+    // The rows stamped t for one product and side
+    Slice find(Timestamp t, ProductId p, OrderBookType side) const {
+        Slice s = slice(t);
+        uint32_t key = groupKey(p, side);
+        size_t first = partitionPoint(s.begin, s.end, [&](size_t row) { return groupKey(row) < key; });
+        size_t last = partitionPoint(first, s.end, [&](size_t row) { return groupKey(row) <= key; });
+        return Slice{first, last};
+    }
+
+    OrderBookEntry entry(size_t row) const {
+        return OrderBookEntry{price[row], amount[row], timestamp[row],
+                              product[row], orderType[row], account[row]};
+    }
+
+    void reserve(size_t rows) {
+        price.reserve(rows);
+        amount.reserve(rows);
+        timestamp.reserve(rows);
+        product.reserve(rows);
+        orderType.reserve(rows);
+        account.reserve(rows);
+    }
+
+    // Adds e to the newest slice or starts a new one; the caller keeps the
+    // timestamp order
+    void push_back(const OrderBookEntry& e) {
+        if (!empty() && e.timestamp == timestamp.back() &&
+            groupKey(e.product, e.orderType) < groupKey(size() - 1)) {
+            insert(e);
+            return;
+        }
+        appendRow(e);
+    }
+
+    // Appends rows in timestamp order, grouping each touched slice once
+    void append(const OrderRows& entries) {
+        reserve(size() + entries.size());
+        size_t firstSlice = sliceTimes.empty() ? 0 : sliceTimes.size() - 1;
+        for (const OrderBookEntry& e : entries) appendRow(e);
+        for (size_t k = firstSlice; k < sliceTimes.size(); ++k) groupSlice(k);
+    }
+
+    // Inserts e after the rows with the same or an earlier timestamp and,
+    // among its own timestamp's rows, at the end of its product and side group
+    void insert(const OrderBookEntry& e) {
+        size_t k = std::lower_bound(sliceTimes.begin(), sliceTimes.end(), e.timestamp) - sliceTimes.begin();
+        bool found = k < sliceTimes.size() && sliceTimes[k] == e.timestamp;
+        size_t row = k < sliceStarts.size() ? sliceStarts[k] : size();
+        if (found) {
+            Slice s = sliceAt(k);
+            uint32_t key = groupKey(e.product, e.orderType);
+            row = partitionPoint(s.begin, s.end, [&](size_t r) { return groupKey(r) <= key; });
+        }
+        if (!found) {
+            sliceTimes.insert(sliceTimes.begin() + k, e.timestamp);
+            sliceStarts.insert(sliceStarts.begin() + k, row);
+        }
+        for (size_t i = k + 1; i < sliceStarts.size(); ++i) ++sliceStarts[i];
+        price.insert(price.begin() + row, e.price);
+        amount.insert(amount.begin() + row, e.amount);
+        timestamp.insert(timestamp.begin() + row, e.timestamp);
+        product.insert(product.begin() + row, e.product);
+        orderType.insert(orderType.begin() + row, e.orderType);
+        account.insert(account.begin() + row, e.account);
+    }
+
+    // Adds a batch of rows in any order. The batch is sorted once, then
+    // merged with the stored rows in a single pass; a batch that starts at
+    // or after the newest row is simply appended. Among rows with the same
+    // timestamp, product and side, stored rows stay first.
+    void merge(OrderRows& batch) {
+        if (batch.empty()) return;
+        std::stable_sort(batch.begin(), batch.end(), [](const OrderBookEntry& a, const OrderBookEntry& b) {
+            if (a.timestamp != b.timestamp) return a.timestamp < b.timestamp;
+            return groupKey(a.product, a.orderType) < groupKey(b.product, b.orderType);
+        });
+        if (empty() || batch.front().timestamp >= timestamp.back()) {
+            append(batch);
+            return;
+        }
+        OrderStore merged;
+        merged.reserve(size() + batch.size());
+        size_t row = 0;
+        for (const OrderBookEntry& e : batch) {
+            uint32_t key = groupKey(e.product, e.orderType);
+            while (row < size() && (timestamp[row] < e.timestamp ||
+                                    (timestamp[row] == e.timestamp && groupKey(row) <= key))) {
+                merged.appendRow(entry(row++));
+            }
+            merged.appendRow(e);
+        }
+        while (row < size()) merged.appendRow(entry(row++));
+        *this = std::move(merged);
+    }
+
+    // Drops the rows stamped before t
+    void eraseBefore(Timestamp t) {
+        size_t k = std::lower_bound(sliceTimes.begin(), sliceTimes.end(), t) - sliceTimes.begin();
+        size_t rows = rowsBefore(t);
+        sliceTimes.erase(sliceTimes.begin(), sliceTimes.begin() + k);
+        sliceStarts.erase(sliceStarts.begin(), sliceStarts.begin() + k);
+        for (size_t& start : sliceStarts) start -= rows;
+        price.erase(price.begin(), price.begin() + rows);
+        amount.erase(amount.begin(), amount.begin() + rows);
+        timestamp.erase(timestamp.begin(), timestamp.begin() + rows);
+        product.erase(product.begin(), product.begin() + rows);
+        orderType.erase(orderType.begin(), orderType.begin() + rows);
+        account.erase(account.begin(), account.begin() + rows);
+    }
+
+private:
+    Column<Timestamp> sliceTimes; // distinct timestamps, ascending
+    Column<size_t> sliceStarts;   // first row of each slice
+
+    Slice sliceAt(size_t k) const {
+        return Slice{sliceStarts[k], k + 1 < sliceStarts.size() ? sliceStarts[k + 1] : size()};
+    }
+
+    static uint32_t groupKey(ProductId p, OrderBookType side) {
+        return static_cast<uint32_t>(p) << 8 | static_cast<uint8_t>(side);
+    }
+
+    uint32_t groupKey(size_t row) const { return groupKey(product[row], orderType[row]); }
+
+    // First row in [first, last) for which pred is false; pred must be true
+    // for a prefix of the range and false for the rest
+    template <typename Pred>
+    static size_t partitionPoint(size_t first, size_t last, Pred pred) {
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (pred(mid)) first = mid + 1;
+            else last = mid;
+        }
+        return first;
+    }
+
+    void appendRow(const OrderBookEntry& e) {
+        if (sliceTimes.empty() || e.timestamp != sliceTimes.back()) {
+            sliceTimes.push_back(e.timestamp);
+            sliceStarts.push_back(size());
+        }
+        price.push_back(e.price);
+        amount.push_back(e.amount);
+        timestamp.push_back(e.timestamp);
+        product.push_back(e.product);
+        orderType.push_back(e.orderType);
+        account.push_back(e.account);
+    }
+
+    // Stable-sorts slice k's rows by product and side if they are not already
+    void groupSlice(size_t k) {
+        Slice s = sliceAt(k);
+        bool grouped = true;
+        for (size_t row = s.begin + 1; row < s.end && grouped; ++row) grouped = groupKey(row - 1) <= groupKey(row);
+        if (grouped) return;
+        std::vector<size_t> rows(s.end - s.begin);
+        std::iota(rows.begin(), rows.end(), s.begin);
+        std::stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) { return groupKey(a) < groupKey(b); });
+        gather(price, rows, s.begin);
+        gather(amount, rows, s.begin);
+        gather(product, rows, s.begin);
+        gather(orderType, rows, s.begin);
+        gather(account, rows, s.begin);
+    }
+
+    template <typename T>
+    static void gather(Column<T>& column, const std::vector<size_t>& rows, size_t at) {
+        std::vector<T> picked;
+        picked.reserve(rows.size());
+        for (size_t row : rows) picked.push_back(column[row]);
+        std::copy(picked.begin(), picked.end(), column.begin() + at);
+    }
+};
+
+// Read-only view of one order, either a row of an OrderStore or an entry
+// held elsewhere, for code that wants an entry. Valid until the order's
+// owner is next modified.
+class OrderRef {
+public:
+    OrderRef(const OrderStore& _store, size_t _row) : store(&_store), row(_row) {}
+    explicit OrderRef(const OrderBookEntry& _order) : order(&_order) {}
+
+    Price price() const { return store ? store->price[row] : order->price; }
+    Quantity amount() const { return store ? store->amount[row] : order->amount; }
+    Timestamp timestamp() const { return store ? store->timestamp[row] : order->timestamp; }
+    ProductId product() const { return store ? store->product[row] : order->product; }
+    OrderBookType orderType() const { return store ? store->orderType[row] : order->orderType; }
+    AccountId account() const { return store ? store->account[row] : order->account; }
+
+    OrderBookEntry entry() const { return store ? store->entry(row) : *order; }
+
+private:
+    const OrderStore* store = nullptr;
+    size_t row = 0;
+    const OrderBookEntry* order = nullptr;
+};
+
+// Contiguous run of OrderStore rows viewed in place, without copying. Valid
+// until the store is next modified.
+class OrderSpan {
+public:
+    class iterator {
+    public:
+        iterator(const OrderStore* _store, size_t _row) : store(_store), row(_row) {}
+        OrderRef operator*() const { return OrderRef(*store, row); }
+        iterator& operator++() { ++row; return *this; }
+        bool operator!=(const iterator& o) const { return row != o.row; }
+
+    private:
+        const OrderStore* store;
+        size_t row;
+    };
+
+    OrderSpan(const OrderStore& _store, OrderStore::Slice _rows) : store(&_store), rows(_rows) {}
+
+    size_t size() const { return rows.end - rows.begin; }
+    bool empty() const { return rows.begin == rows.end; }
+    OrderRef operator[](size_t i) const { return OrderRef(*store, rows.begin + i); }
+    iterator begin() const { return iterator(store, rows.begin); }
+    iterator end() const { return iterator(store, rows.end); }
+
+    // The span's slice of the price column
+    const Price* prices() const { return store->price.data() + rows.begin; }
+
+private:
+    const OrderStore* store;
+    OrderStore::Slice rows;
+};
+
+// ==========================================
+// 2. CSV / String Parsing Utilities
+// ==========================================
+
+class CSVReader {
+public:
+    // Splits line on separator into views written to the caller's buffer,
+    // which is cleared first so its capacity can be reused between calls.
+    // Leading separators are skipped and an empty field ends the scan.
+    static size_t tokenise(std::string_view line, char separator, std::vector<std::string_view>& tokens) {
+        tokens.clear();
+        const char* start = line.data();
+        bool stopped = false;
+        forEachDelimiter(line, separator, separator, [&](const char* sep) {
+            if (sep == start) {
+                if (!tokens.empty()) {
+                    stopped = true;
+                    return false;
+                }
+                start = sep + 1; // still inside the leading separators
+                return true;
+            }
+            tokens.emplace_back(start, sep - start);
+            start = sep + 1;
+            return true;
+        });
+        const char* end = line.data() + line.size();
+        if (!stopped && start < end) tokens.emplace_back(start, end - start);
+        return tokens.size();
+    }
+
+    // Parses the fixed "YYYY/MM/DD HH:MM:SS[.ffffff]" layout used by the
+    // datasets into microseconds since the epoch. Returns false on any
+    // deviation from that layout.
+    static bool parseTimestamp(std::string_view s, Timestamp& micros) {
+        if (s.size() < 19 || s.size() > 26 || (s.size() > 19 && s[19] != '.')) return false;
+        if (s[4] != '/' || s[7] != '/' || s[10] != ' ' || s[13] != ':' || s[16] != ':') return false;
+        int year, month, day, hour, minute, second;
+        if (!parseDigits(s.substr(0, 4), year) || !parseDigits(s.substr(5, 2), month) ||
+            !parseDigits(s.substr(8, 2), day) || !parseDigits(s.substr(11, 2), hour) ||
+            !parseDigits(s.substr(14, 2), minute) || !parseDigits(s.substr(17, 2), second)) {
+            return false;
+        }
+        if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 || minute > 59 ||
+            second > 60) {
+            return false;
+        }
+        int fraction = 0;
+        if (s.size() > 19) {
+            std::string_view digits = s.substr(20);
+            if (digits.empty() || !parseDigits(digits, fraction)) return false;
+            for (size_t i = digits.size(); i < 6; ++i) fraction *= 10;
+        }
+        int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+        micros = seconds * 1000000 + fraction;
+        return true;
+    }
+
+    // Formats micros back into the dataset layout, always with six fraction digits.
+    static std::string formatTimestamp(Timestamp micros) {
+        int64_t seconds = micros / 1000000;
+        int64_t fraction = micros % 1000000;
+        if (fraction < 0) {
+            fraction += 1000000;
+            --seconds;
+        }
+        int64_t days = seconds / 86400;
+        int64_t secondOfDay = seconds % 86400;
+        if (secondOfDay < 0) {
+            secondOfDay += 86400;
+            --days;
+        }
+        // civil-from-days, proleptic Gregorian calendar
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t doe = days - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        int64_t day = doy - (153 * mp + 2) / 5 + 1;
+        int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        int64_t year = yoe + era * 400 + (month <= 2);
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%04lld/%02lld/%02lld %02lld:%02lld:%02lld.%06lld",
+                      (long long)year, (long long)month, (long long)day, (long long)(secondOfDay / 3600),
+                      (long long)(secondOfDay / 60 % 60), (long long)(secondOfDay % 60), (long long)fraction);
+        return buf;
+    }
+
+    // Parses one row (without its newline) and appends it to out.
+    // Returns false if the row is malformed.
+    static bool parseRow(std::string_view line, OrderRows& out) {
+        std::string_view fields[kFields];
+        size_t count = 0;
+        bool tooMany = false;
+        const char* start = line.data();
+        forEachDelimiter(line, ',', ',', [&](const char* d) {
+            if (count == kFields - 1) {
+                tooMany = true;
+                return false;
+            }
+            fields[count++] = std::string_view(start, d - start);
+            start = d + 1;
+            return true;
+        });
+        if (tooMany || count != kFields - 1) return false;
+        fields[count] = std::string_view(start, line.data() + line.size() - start);
+        return stringsToOBE(fields, out);
+    }
+
+    // Parses a whole field as a Price or Quantity without allocating or
+    // throwing. Returns std::errc() on success, invalid_argument if the field
+    // is not entirely a number and result_out_of_range if it has more than
+    // eight significant decimals or does not fit.
+    template <typename Tag>
+    static std::errc parseDecimal(std::string_view field, FixedPoint<Tag>& value) {
+        int64_t units;
+        std::errc ec = parseFixed(field, units, FixedPoint<Tag>::kScale);
+        if (ec == std::errc()) value = FixedPoint<Tag>::fromUnits(units);
+        return ec;
+    }
+
+    // Parses a whole field as a decimal integer, with the same error codes.
+    template <typename Int>
+    static std::errc parseInt(std::string_view field, Int& value) {
+        auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+        if (ec == std::errc() && ptr != field.data() + field.size()) return std::errc::invalid_argument;
+        return ec;
+    }
+
+    // Converts a decimal such as "0.00000078" exactly into an integer count of
+    // 10^-scale units (78 at scale 8). Digits beyond the scale must be zeros,
+    // otherwise the value is not representable and result_out_of_range is
+    // returned, as it is on int64 overflow.
+    static std::errc parseFixed(std::string_view field, int64_t& units, int scale) {
+        const char* p = field.data();
+        const char* end = p + field.size();
+        bool negative = p < end && *p == '-';
+        if (negative) ++p;
+        uint64_t value = 0;
+        bool any = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (value > (UINT64_MAX - 9) / 10) return std::errc::result_out_of_range;
+            value = value * 10 + (*p - '0');
+        }
+        int fraction = 0;
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+                if (fraction < scale) {
+                    if (value > (UINT64_MAX - 9) / 10) return std::errc::result_out_of_range;
+                    value = value * 10 + (*p - '0');
+                    ++fraction;
+                } else if (*p != '0') {
+                    return std::errc::result_out_of_range;
+                }
+            }
+        }
+        if (!any || p != end) return std::errc::invalid_argument;
+        for (; fraction < scale; ++fraction) {
+            if (value > UINT64_MAX / 10) return std::errc::result_out_of_range;
+            value *= 10;
+        }
+        if (value > static_cast<uint64_t>(INT64_MAX)) return std::errc::result_out_of_range;
+        units = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+        return std::errc();
+    }
+
+    // Returns a pointer to the first c in [p, end), or end if there is none.
+    static const char* findChar(const char* p, const char* end, char c) {
+        const char* found = end;
+        forEachDelimiter(std::string_view(p, end - p), c, c, [&](const char* hit) {
+            found = hit;
+            return false;
+        });
+        return found;
+    }
+
+    // Parses a whole CSV image (timestamp,product,side,price,amount per line)
+    // straight from memory and returns the rows in timestamp order, ties kept
+    // in file order. Large images are split on newline boundaries and parsed
+    // on up to `threads` threads. Blank and malformed lines are skipped.
+    static OrderRows readCSV(std::string_view data, unsigned threads = 1) {
+        std::vector<std::string_view> chunks = splitChunks(data, threads);
+        std::vector<OrderRows> parts(chunks.size());
+        std::vector<size_t> bad(chunks.size(), 0);
+        std::vector<std::exception_ptr> errors(chunks.size());
+        auto parse = [&](size_t i) {
+            try {
+                parseChunk(chunks[i], parts[i], bad[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunks.size(); ++i) workers.emplace_back(parse, i);
+        parse(0);
+        for (std::thread& w : workers) w.join();
+        for (std::exception_ptr& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+
+        OrderRows entries = mergeChunks(parts);
+        size_t badTotal = 0;
+        for (size_t b : bad) badTotal += b;
+        std::cout << "CSVReader::readCSV read " << entries.size() << " entries";
+        if (chunks.size() > 1) std::cout << " on " << chunks.size() << " threads";
+        if (badTotal > 0) std::cout << " (" << badTotal << " bad lines skipped)";
+        std::cout << std::endl;
+        return entries;
+    }
+
+private:
+    static constexpr size_t kFields = 5;
+    static constexpr size_t kBlock = 32;
+    static constexpr size_t kMinChunk = 1 << 20; // smaller chunks are not worth a thread
+
+    // Cuts data into at most n pieces, each ending just after a newline.
+    static std::vector<std::string_view> splitChunks(std::string_view data, unsigned n) {
+        std::vector<std::string_view> chunks;
+        size_t target = std::max(data.size() / std::max(n, 1u), kMinChunk);
+        const char* p = data.data();
+        const char* end = p + data.size();
+        while (p < end) {
+            const char* cut = end;
+            if (static_cast<size_t>(end - p) > target) {
+                cut = findChar(p + target, end, '\n');
+                if (cut < end) ++cut;
+            }
+            chunks.emplace_back(p, cut - p);
+            p = cut;
+        }
+        if (chunks.empty()) chunks.emplace_back(data);
+        return chunks;
+    }
+
+    // Parses one newline-aligned chunk and leaves it sorted by timestamp.
+    static void parseChunk(std::string_view data, OrderRows& entries, size_t& bad) {
+        entries.reserve(data.size() / 64); // rough bytes-per-row estimate
+        std::string_view fields[kFields];
+        size_t count = 0;
+        const char* start = data.data();
+        auto endRow = [&]() {
+            std::string_view& last = fields[std::min(count, kFields) - 1];
+            if (count <= kFields && !last.empty() && last.back() == '\r') last.remove_suffix(1);
+            if (count == 1 && fields[0].empty()) return; // blank line
+            if (count != kFields || !stringsToOBE(fields, entries)) ++bad;
+        };
+        forEachDelimiter(data, ',', '\n', [&](const char* d) {
+            if (count < kFields) fields[count] = std::string_view(start, d - start);
+            ++count;
+            if (*d == '\n') {
+                endRow();
+                count = 0;
+            }
+            start = d + 1;
+            return true;
+        });
+        const char* end = data.data() + data.size();
+        if (start < end) {
+            if (count < kFields) fields[count] = std::string_view(start, end - start);
+            ++count;
+            endRow();
+        }
+        if (!std::is_sorted(entries.begin(), entries.end(), OrderBookEntry::compareByTimestamp)) {
+            std::stable_sort(entries.begin(), entries.end(), OrderBookEntry::compareByTimestamp);
+        }
+    }
+
+    // Concatenates sorted chunks in file order and merges them pairwise.
+    // std::inplace_merge is stable, so the result equals a stable sort of
+    // the whole file, i.e. exactly what a single-threaded load produces.
+    static OrderRows mergeChunks(std::vector<OrderRows>& parts) {
+        if (parts.size() == 1) return std::move(parts[0]);
+        size_t total = 0;
+        for (auto& part : parts) total += part.size();
+        OrderRows entries;
+        entries.reserve(total);
+        std::vector<size_t> bounds{0};
+        for (auto& part : parts) {
+            std::move(part.begin(), part.end(), std::back_inserter(entries));
+            bounds.push_back(entries.size());
+            OrderRows().swap(part);
+        }
+        for (size_t width = 1; width < parts.size(); width *= 2) {
+            for (size_t i = 0; i + width < parts.size(); i += 2 * width) {
+                auto first = entries.begin() + bounds[i];
+                auto middle = entries.begin() + bounds[i + width];
+                auto last = entries.begin() + bounds[std::min(i + 2 * width, parts.size())];
+                if (middle != first && middle != last &&
+                    OrderBookEntry::compareByTimestamp(*middle, *(middle - 1))) {
+                    std::inplace_merge(first, middle, last, OrderBookEntry::compareByTimestamp);
+                }
+            }
+        }
+        return entries;
+    }
+
+    // Bit i of the result is set when block[i] equals a or b.
+    static uint32_t delimiterMask(const char* block, char a, char b) {
+#if defined(__AVX2__)
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)),
+                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+#elif defined(__SSE2__)
+        __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+        uint32_t mlo = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(lo, va), _mm_cmpeq_epi8(lo, vb)));
+        uint32_t mhi = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(hi, va), _mm_cmpeq_epi8(hi, vb)));
+        return mlo | (mhi << 16);
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kBlock; ++i) {
+            mask |= static_cast<uint32_t>(block[i] == a || block[i] == b) << i;
+        }
+        return mask;
+#endif
+    }
+
+    // Calls fn(pos) for every a or b in data, in order, until fn returns false.
+    template <typename Fn>
+    static void forEachDelimiter(std::string_view data, char a, char b, Fn fn) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        for (; p + kBlock <= end; p += kBlock) {
+            for (uint32_t mask = delimiterMask(p, a, b); mask != 0; mask &= mask - 1) {
+                if (!fn(p + __builtin_ctz(mask))) return;
+            }
+        }
+        if (p < end) {
+            char tail[kBlock] = {};
+            size_t n = end - p;
+            std::memcpy(tail, p, n);
+            uint32_t mask = delimiterMask(tail, a, b) & ((1u << n) - 1);
+            for (; mask != 0; mask &= mask - 1) {
+                if (!fn(p + __builtin_ctz(mask))) return;
+            }
+        }
+    }
+
+    static bool parseDigits(std::string_view s, int& value) {
+        value = 0;
+        for (char c : s) {
+            if (c < '0' || c > '9') return false;
+            value = value * 10 + (c - '0');
+        }
+        return true;
+    }
+
+    static int daysInMonth(int year, int month) {
+        static constexpr int kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+        return month == 2 && leap ? 29 : kDays[month - 1];
+    }
+
+    static int64_t daysFromCivil(int64_t year, int64_t month, int64_t day) {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yoe = year - era * 400;
+        int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    static bool stringsToOBE(const std::string_view (&fields)[kFields], OrderRows& out) {
+        Price price;
+        Quantity amount;
+        Timestamp timestamp;
+        if (!parseTimestamp(fields[0], timestamp)) return false;
+        if (parseDecimal(fields[3], price) != std::errc() || parseDecimal(fields[4], amount) != std::errc()) {
+            return false;
+        }
+        out.emplace_back(price, amount, timestamp, Symbols::product(fields[1]),
+                         OrderBookEntry::stringToOrderBookType(fields[2]));
+        return true;
+    }
+
+};
+
+// ==========================================
+// 3. Dataset Files (mmap, binary snapshots)
+// ==========================================
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + filename);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("cannot mmap " + filename);
+            }
+            ::madvise(p, length, MADV_SEQUENTIAL);
+            base = static_cast<const char*>(p);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (base) ::munmap(const_cast<char*>(base), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return std::string_view(base, length); }
+
+    // Starts reading part of view() into the page cache in the background,
+    // so a cold load parses pages already read while the rest arrive
+    // instead of stalling on every fault.
+    void willNeed(std::string_view part) const {
+        if (part.empty()) return;
+        uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+        uintptr_t start = reinterpret_cast<uintptr_t>(part.data()) & ~(page - 1);
+        ::madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(part.data()) + part.size() - start,
+                  MADV_WILLNEED);
+    }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+};
+
+// Reads a file sequentially into two fixed-size buffers on a background
+// thread with pread, so the next block is read while the caller parses the
+// current one and I/O overlaps with parsing instead of adding to it.
+class BlockReader {
+public:
+    BlockReader(int _fd, uint64_t _offset, size_t blockSize) : fd(_fd), offset(_offset) {
+        for (Slot& slot : slots) slot.data.resize(blockSize);
+        worker = std::thread([this] { run(); });
+    }
+
+    ~BlockReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        worker.join();
+    }
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Returns the next block, waiting if it is still being read. The view is
+    // valid until the following call. An empty view means end of file as of
+    // this call; calling again checks for bytes appended since.
+    std::string_view next() {
+        std::unique_lock<std::mutex> lock(mutex);
+        release();
+        waitFull(lock);
+        if (slots[current].size == 0) {
+            // the end was seen before this call: consume that block so the
+            // worker reads again, and wait for the fresh result
+            held = true;
+            release();
+            waitFull(lock);
+        }
+        if (failed) throw std::runtime_error("read failed");
+        held = true;
+        return std::string_view(slots[current].data.data(), slots[current].size);
+    }
+
+private:
+    struct Slot {
+        std::vector<char> data;
+        size_t size = 0;
+        bool full = false;
+    };
+
+    int fd;
+    uint64_t offset; // file offset of the next block to read
+    Slot slots[2];
+    size_t current = 0; // slot the caller reads next or holds
+    size_t filling = 0; // slot the worker fills next
+    bool held = false;
+    bool parked = false; // worker reached end of file and waits to retry
+    bool failed = false;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::thread worker;
+
+    void release() {
+        if (!held) return;
+        Slot& slot = slots[current];
+        if (slot.size == 0) parked = false; // let the worker retry the end
+        slot.full = false;
+        current ^= 1;
+        held = false;
+        ready.notify_all();
+    }
+
+    void waitFull(std::unique_lock<std::mutex>& lock) {
+        ready.wait(lock, [this] { return slots[current].full; });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return stopping || (!slots[filling].full && !parked); });
+            if (stopping) return;
+            Slot& slot = slots[filling];
+            uint64_t at = offset;
+            lock.unlock();
+            ssize_t n = ::pread(fd, slot.data.data(), slot.data.size(), static_cast<off_t>(at));
+            lock.lock();
+            if (n < 0) failed = true;
+            slot.size = n > 0 ? static_cast<size_t>(n) : 0;
+            slot.full = true;
+            offset += slot.size;
+            parked = slot.size == 0;
+            filling ^= 1;
+            ready.notify_all();
+        }
+    }
+};
+
+// A forward-only supply of rows in timestamp order, feeding a streamed OrderBook.
+class OrderSource {
+public:
+    virtual ~OrderSource() = default;
+
+    // Appends the next row to out. Returns false when no row is available,
+    // which is final once exhausted() is true.
+    virtual bool next(OrderRows& out) = 0;
+    virtual bool exhausted() const = 0;
+    virtual size_t badRows() const = 0;
+};
+
+// Reads a CSV dataset front to back in fixed-size blocks, one row at a time,
+// so memory use is bounded by the block size rather than the file size.
+// Blocks come from a BlockReader; lines are parsed in place inside a block
+// and only a line straddling two blocks is copied to be reassembled.
+// A following stream treats end of file as "no rows yet": it keeps the file
+// open at its byte offset, holds back any partial last line, and picks up
+// whatever a writer appends on later calls.
+class CSVStream : public OrderSource {
+public:
+    explicit CSVStream(const std::string& filename, uint64_t startOffset = 0, bool _follow = false)
+    : follow(_follow) {
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + filename);
+        reader = std::make_unique<BlockReader>(fd, startOffset, kBlockSize);
+    }
+
+    ~CSVStream() {
+        reader.reset();
+        ::close(fd);
+    }
+
+    CSVStream(const CSVStream&) = delete;
+    CSVStream& operator=(const CSVStream&) = delete;
+
+    // Appends the next well-formed row to out. Returns false when no complete
+    // row is available: at end of file, or for now when following.
+    bool next(OrderRows& out) override {
+        std::string_view line;
+        while (nextLine(line)) {
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) continue;
+            if (CSVReader::parseRow(line, out)) return true;
+            ++bad;
+        }
+        return false;
+    }
+
+    size_t badRows() const override { return bad; }
+
+    // True once a non-following stream has returned its last row
+    bool exhausted() const override { return eof && carry.empty(); }
+
+private:
+    static constexpr size_t kBlockSize = 1 << 20;
+
+    int fd;
+    std::unique_ptr<BlockReader> reader;
+    std::string_view block; // block being parsed, owned by reader
+    size_t pos = 0;         // next unparsed byte in block
+    std::string carry;      // start of a line continued in the next block
+    std::string joined;     // a reassembled line handed out by nextLine
+    bool follow;
+    bool eof = false;
+    size_t bad = 0;
+
+    bool nextLine(std::string_view& line) {
+        while (true) {
+            const char* begin = block.data() + pos;
+            const char* end = block.data() + block.size();
+            const char* nl = CSVReader::findChar(begin, end, '\n');
+            if (nl < end) {
+                pos = nl - block.data() + 1;
+                if (carry.empty()) {
+                    line = std::string_view(begin, nl - begin);
+                } else {
+                    carry.append(begin, nl);
+                    line = takeCarry();
+                }
+                return true;
+            }
+            carry.append(begin, end);
+            block = std::string_view();
+            pos = 0;
+            if (eof) return false;
+            block = reader->next();
+            if (block.empty()) {
+                if (follow) return false;
+                eof = true;
+                if (carry.empty()) return false;
+                line = takeCarry(); // last line has no newline
+                return true;
+            }
+        }
+    }
+
+    std::string_view takeCarry() {
+        joined.swap(carry);
+        carry.clear();
+        return joined;
+    }
+};
+
+// Sparse index of a timestamp-ordered CSV file: (timestamp, byte offset)
+// pairs for the first row of a timestamp, sampled about every kStride bytes.
+// It is built on first use and kept in a "<file>.idx" sidecar tagged with
+// the CSV's size and mtime, so it is rebuilt only when the file changes.
+// Seeking then touches one stride of the mapped file instead of the whole day.
+class SeekIndex {
+public:
+    // Byte offset of the first row at or after t, or the file size if there
+    // is none. Falls back to 0 (read everything) for unordered files.
+    static uint64_t seek(const std::string& filename, Timestamp t) {
+        MappedFile file(filename);
+        std::string_view data = file.view();
+        struct stat st;
+        if (::stat(filename.c_str(), &st) != 0) throw std::runtime_error("cannot stat " + filename);
+        int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        std::vector<Entry> entries;
+        bool ordered;
+        if (!load(filename + ".idx", data.size(), mtime, entries, ordered)) {
+            ordered = build(data, entries);
+            save(filename + ".idx", data.size(), mtime, entries, ordered);
+        }
+        if (!ordered) {
+            std::cout << "SeekIndex: " << filename << " is not in timestamp order, reading from the start" << std::endl;
+            return 0;
+        }
+        auto it = std::upper_bound(entries.begin(), entries.end(), t,
+                                   [](Timestamp value, const Entry& e) { return value < e.timestamp; });
+        uint64_t offset = it == entries.begin() ? 0 : std::prev(it)->offset;
+        // walk forward from the sample to the exact row
+        while (offset < data.size()) {
+            const char* begin = data.data() + offset;
+            const char* nl = CSVReader::findChar(begin, data.data() + data.size(), '\n');
+            Timestamp rowTime;
+            if (rowTimestamp(std::string_view(begin, nl - begin), rowTime) && rowTime >= t) break;
+            offset = nl - data.data() + 1;
+        }
+        return std::min<uint64_t>(offset, data.size());
+    }
+
+private:
+    static constexpr char kMagic[4] = {'O', 'B', 'X', '1'};
+    static constexpr uint64_t kStride = 64 * 1024;
+
+    struct Entry {
+        Timestamp timestamp;
+        uint64_t offset;
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t ordered;
+        uint64_t fileBytes;
+        int64_t fileMtime;
+        uint64_t count;
+    };
+
+    static bool rowTimestamp(std::string_view line, Timestamp& t) {
+        return CSVReader::parseTimestamp(line.substr(0, line.find(',')), t);
+    }
+
+    // Samples the file, reading only the timestamp of each row. Returns false
+    // if timestamps ever go backwards, since seeking would then skip rows.
+    static bool build(std::string_view data, std::vector<Entry>& entries) {
+        entries.clear();
+        const char* p = data.data();
+        const char* end = p + data.size();
+        uint64_t nextSample = 0;
+        Timestamp last = std::numeric_limits<Timestamp>::min();
+        while (p < end) {
+            const char* nl = CSVReader::findChar(p, end, '\n');
+            Timestamp t;
+            if (rowTimestamp(std::string_view(p, nl - p), t)) {
+                if (t < last) return false;
+                uint64_t offset = p - data.data();
+                if (t != last && offset >= nextSample) {
+                    entries.push_back({t, offset});
+                    nextSample = offset + kStride;
+                }
+                last = t;
+            }
+            p = nl + 1;
+        }
+        return true;
+    }
+
+    // Returns false if there is no sidecar for this version of the file.
+    static bool load(const std::string& path, uint64_t fileBytes, int64_t fileMtime, std::vector<Entry>& entries,
+                     bool& ordered) {
+        std::ifstream in(path, std::ios::binary);
+        Header header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, kMagic, 4) != 0 || header.fileBytes != fileBytes ||
+            header.fileMtime != fileMtime) {
+            return false;
+        }
+        entries.resize(header.count);
+        if (!in.read(reinterpret_cast<char*>(entries.data()), header.count * sizeof(Entry))) return false;
+        ordered = header.ordered != 0;
+        return true;
+    }
+
+    static void save(const std::string& path, uint64_t fileBytes, int64_t fileMtime, std::vector<Entry>& entries,
+                     bool ordered) {
+        if (!ordered) entries.clear(); // only the verdict is worth keeping
+        Header header{};
+        std::memcpy(header.magic, kMagic, 4);
+        header.ordered = ordered;
+        header.fileBytes = fileBytes;
+        header.fileMtime = fileMtime;
+        header.count = entries.size();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+        // an unwritable directory only costs rebuilding the index next time
+    }
+};
+
+// Catalog of a directory of per-day CSV files (20200317.csv, ...). Each
+// file's byte size, modification time, first and last timestamp and
+// per-product row counts are kept in a text manifest next to the data, so
+// a directory is only parsed once and files are re-scanned only when they
+// change. Manifest lines are
+//   file,bytes,mtime (ns),first,last,rows,PRODUCT:rows;PRODUCT:rows...
+class DatasetCatalog {
+public:
+    struct FileInfo {
+        std::string name;
+        uint64_t bytes = 0;
+        int64_t mtime = 0;
+        Timestamp first = 0;
+        Timestamp last = 0;
+        uint64_t rows = 0;
+        std::map<std::string, uint64_t> productRows;
+    };
 
-    OrderBookEntry(double _price, double _amount, std::string _timestamp, 
-                   std::string _product, OrderBookType _orderType, std::string _username = "dataset")
-    : price(_price), amount(_amount), timestamp(_timestamp), 
-      product(_product), orderType(_orderType), username(_username) {}
+    static constexpr const char* kManifest = "catalog.manifest";
 
-    static bool compareByTimestamp(const OrderBookEntry& e1, const OrderBookEntry& e2) {
-        return e1.timestamp < e2.timestamp;
+    // Loads the manifest, re-scans new or changed CSV files and rewrites it.
+    explicit DatasetCatalog(const std::string& _directory) : directory(_directory) {
+        namespace fs = std::filesystem;
+        std::map<std::string, FileInfo> known = readManifest();
+        std::vector<std::string> names;
+        for (const fs::directory_entry& entry : fs::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".csv") {
+                names.push_back(entry.path().filename().string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        bool changed = names.size() != known.size();
+        for (const std::string& name : names) {
+            fs::path path = fs::path(directory) / name;
+            struct stat st;
+            if (::stat(path.c_str(), &st) != 0) throw std::runtime_error("cannot stat " + path.string());
+            uint64_t bytes = static_cast<uint64_t>(st.st_size);
+            int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+            auto it = known.find(name);
+            if (it != known.end() && it->second.bytes == bytes && it->second.mtime == mtime) {
+                files.push_back(it->second);
+                continue;
+            }
+            files.push_back(scanFile(path.string(), name, bytes, mtime));
+            changed = true;
+        }
+        if (changed) writeManifest();
     }
-    
-    static bool compareByPriceAsc(const OrderBookEntry& e1, const OrderBookEntry& e2) {
-        return e1.price < e2.price;
+
+    const std::vector<FileInfo>& getFiles() const { return files; }
+
+    // Paths of the files holding rows in [from, to], in name order
+    std::vector<std::string> filesFor(Timestamp from, Timestamp to) const {
+        std::vector<std::string> paths;
+        for (const FileInfo& f : files) {
+            if (f.rows > 0 && f.last >= from && f.first <= to) {
+                paths.push_back((std::filesystem::path(directory) / f.name).string());
+            }
+        }
+        return paths;
     }
 
-    static bool compareByPriceDesc(const OrderBookEntry& e1, const OrderBookEntry& e2) {
-        return e1.price > e2.price;
+private:
+    std::string directory;
+    std::vector<FileInfo> files;
+
+    std::string manifestPath() const { return (std::filesystem::path(directory) / kManifest).string(); }
+
+    // Summarises a CSV file in one forward pass over the mapping, parsing
+    // only each line's timestamp and product, so memory use does not grow
+    // with the file. Lines without five fields or a valid timestamp are not
+    // counted.
+    static FileInfo scanFile(const std::string& path, const std::string& name, uint64_t bytes, int64_t mtime) {
+        FileInfo info;
+        info.name = name;
+        info.bytes = bytes;
+        info.mtime = mtime;
+        MappedFile file(path);
+        std::string_view data = file.view();
+        std::vector<uint64_t> counts; // indexed by ProductId
+        const char* p = data.data();
+        const char* end = p + data.size();
+        while (p < end) {
+            const char* eol = CSVReader::findChar(p, end, '\n');
+            std::string_view line(p, eol - p);
+            p = eol < end ? eol + 1 : end;
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            size_t productAt = line.find(',') + 1;
+            size_t sideAt = line.find(',', productAt) + 1;
+            if (productAt == 0 || sideAt == 0 || std::count(line.begin() + sideAt, line.end(), ',') != 2) continue;
+            Timestamp timestamp;
+            if (!CSVReader::parseTimestamp(line.substr(0, productAt - 1), timestamp)) continue;
+            ProductId product = Symbols::product(line.substr(productAt, sideAt - 1 - productAt));
+            if (info.rows == 0 || timestamp < info.first) info.first = timestamp;
+            if (info.rows == 0 || timestamp > info.last) info.last = timestamp;
+            ++info.rows;
+            if (product >= counts.size()) counts.resize(product + 1);
+            ++counts[product];
+        }
+        for (size_t product = 0; product < counts.size(); ++product) {
+            if (counts[product] > 0) info.productRows[Symbols::productName(product)] = counts[product];
+        }
+        return info;
+    }
+
+    std::map<std::string, FileInfo> readManifest() const {
+        std::map<std::string, FileInfo> known;
+        std::ifstream in(manifestPath());
+        std::string line;
+        std::vector<std::string_view> fields, products, pair;
+        while (std::getline(in, line)) {
+            FileInfo info;
+            if (CSVReader::tokenise(line, ',', fields) < 6 ||
+                CSVReader::parseInt(fields[1], info.bytes) != std::errc() ||
+                CSVReader::parseInt(fields[2], info.mtime) != std::errc() ||
+                !CSVReader::parseTimestamp(fields[3], info.first) ||
+                !CSVReader::parseTimestamp(fields[4], info.last) ||
+                CSVReader::parseInt(fields[5], info.rows) != std::errc()) {
+                continue; // unreadable entries are simply re-scanned
+            }
+            info.name = std::string(fields[0]);
+            if (fields.size() > 6) {
+                CSVReader::tokenise(fields[6], ';', products);
+                for (std::string_view p : products) {
+                    uint64_t rows;
+                    if (CSVReader::tokenise(p, ':', pair) == 2 && CSVReader::parseInt(pair[1], rows) == std::errc()) {
+                        info.productRows[std::string(pair[0])] = rows;
+                    }
+                }
+            }
+            known[info.name] = info;
+        }
+        return known;
+    }
+
+    void writeManifest() const {
+        std::ofstream out(manifestPath(), std::ios::trunc);
+        if (!out) {
+            std::cout << "DatasetCatalog: cannot write " << manifestPath() << std::endl;
+            return;
+        }
+        for (const FileInfo& f : files) {
+            out << f.name << ',' << f.bytes << ',' << f.mtime << ',' << CSVReader::formatTimestamp(f.first) << ','
+                << CSVReader::formatTimestamp(f.last) << ',' << f.rows << ',';
+            bool firstProduct = true;
+            for (const auto& [product, rows] : f.productRows) {
+                out << (firstProduct ? "" : ";") << product << ':' << rows;
+                firstProduct = false;
+            }
+            out << '\n';
+        }
     }
 };
 
-// ==========================================
-// 2. CSV / String Parsing Utilities
-// ==========================================
+// Replays the rows in [from, to] from several timestamp-ordered CSV files,
+// merging them with a min-heap on (timestamp, file index) so overlapping
+// days interleave correctly and ties keep catalog order.
+class MergedStream : public OrderSource {
+public:
+    MergedStream(const std::vector<std::string>& paths, Timestamp _from, Timestamp _to)
+    : heads(paths.size()), from(_from), to(_to) {
+        for (const std::string& path : paths) {
+            uint64_t offset = from > std::numeric_limits<Timestamp>::min() ? SeekIndex::seek(path, from) : 0;
+            streams.push_back(std::make_unique<CSVStream>(path, offset));
+        }
+        for (size_t i = 0; i < streams.size(); ++i) advance(i);
+    }
 
-class CSVReader {
+    bool next(OrderRows& out) override {
+        while (!heap.empty()) {
+            auto [timestamp, i] = heap.top();
+            heap.pop();
+            if (timestamp > to) {
+                heap = Heap(); // every remaining row is later still
+                return false;
+            }
+            if (timestamp >= from) out.push_back(heads[i].back());
+            advance(i);
+            if (timestamp >= from) return true;
+        }
+        return false;
+    }
+
+    bool exhausted() const override { return heap.empty(); }
+
+    size_t badRows() const override {
+        size_t bad = 0;
+        for (const auto& stream : streams) bad += stream->badRows();
+        return bad;
+    }
+
+private:
+    using Heap = std::priority_queue<std::pair<Timestamp, size_t>, std::vector<std::pair<Timestamp, size_t>>,
+                                     std::greater<std::pair<Timestamp, size_t>>>;
+
+    std::vector<std::unique_ptr<CSVStream>> streams;
+    std::vector<OrderRows> heads; // the pending row of each stream
+    Heap heap;
+    Timestamp from;
+    Timestamp to;
+
+    void advance(size_t i) {
+        heads[i].clear();
+        if (streams[i]->next(heads[i])) heap.emplace(heads[i].back().timestamp, i);
+    }
+};
+
+// File-local dense product ids for the binary formats, so files do not
+// depend on the interning order of the process that wrote them. Serialised
+// as a u16 length and the name for each product, zero-padded to a multiple
+// of 8 bytes.
+class ProductDictionary {
+public:
+    uint32_t idOf(ProductId product) {
+        auto [it, inserted] = ids.emplace(product, static_cast<uint32_t>(products.size()));
+        if (inserted) products.push_back(product);
+        return it->second;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(products.size()); }
+
+    std::string serialise() const {
+        std::string bytes;
+        for (ProductId product : products) {
+            const std::string& name = Symbols::productName(product);
+            uint16_t len = static_cast<uint16_t>(name.size());
+            bytes.append(reinterpret_cast<const char*>(&len), sizeof(len));
+            bytes.append(name);
+        }
+        bytes.resize((bytes.size() + 7) & ~static_cast<size_t>(7), '\0');
+        return bytes;
+    }
+
+    // Returns the interned product id for each file-local id.
+    static std::vector<ProductId> parse(std::string_view bytes, uint32_t count) {
+        std::vector<ProductId> names;
+        const char* p = bytes.data();
+        const char* end = p + bytes.size();
+        for (uint32_t i = 0; i < count; ++i) {
+            uint16_t len;
+            if (end - p < static_cast<ptrdiff_t>(sizeof(len))) throw std::runtime_error("corrupt product dictionary");
+            std::memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (end - p < len) throw std::runtime_error("corrupt product dictionary");
+            names.push_back(Symbols::product(std::string_view(p, len)));
+            p += len;
+        }
+        return names;
+    }
+
+private:
+    std::map<ProductId, uint32_t> ids;
+    std::vector<ProductId> products;
+};
+
+// Binary columnar snapshot (.obk) of a loaded dataset. Layout, all native
+// little-endian and 8-byte aligned:
+//   Header | product dictionary (u16 length + bytes each) | pad to 8
+//   | i64 timestamps[rows] | i64 prices[rows] | i64 amounts[rows]
+//   | u32 productIds[rows] | u8 sides[rows]
+// Rows are stored in timestamp order, so loading needs no parsing or sorting.
+class SnapshotFile {
+public:
+    static bool isSnapshot(std::string_view data) {
+        return data.size() >= sizeof(Header) && std::memcmp(data.data(), kMagic, 4) == 0;
+    }
+
+    static void write(const std::string& filename, const OrderRows& entries) {
+        ProductDictionary products;
+        std::vector<uint32_t> productIds;
+        productIds.reserve(entries.size());
+        for (const OrderBookEntry& e : entries) productIds.push_back(products.idOf(e.product));
+        std::string dict = products.serialise();
+
+        Header header{};
+        std::memcpy(header.magic, kMagic, 4);
+        header.version = kVersion;
+        header.rows = entries.size();
+        header.products = products.size();
+        header.dictBytes = dict.size();
+
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("cannot create " + filename);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(dict.data(), dict.size());
+        writeColumn(out, entries, [](const OrderBookEntry& e) { return e.timestamp; });
+        writeColumn(out, entries, [](const OrderBookEntry& e) { return e.price.units(); });
+        writeColumn(out, entries, [](const OrderBookEntry& e) { return e.amount.units(); });
+        out.write(reinterpret_cast<const char*>(productIds.data()), productIds.size() * sizeof(uint32_t));
+        writeColumn(out, entries, [](const OrderBookEntry& e) { return static_cast<uint8_t>(e.orderType); });
+        if (!out) throw std::runtime_error("cannot write " + filename);
+    }
+
+    // Builds entries straight from a mapped snapshot image.
+    static OrderRows read(std::string_view data) {
+        if (!isSnapshot(data)) throw std::runtime_error("not an order book snapshot");
+        Header header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.version != kVersion) throw std::runtime_error("unsupported snapshot version");
+        size_t rows = header.rows;
+        size_t columnsAt = sizeof(Header) + header.dictBytes;
+        size_t needed = columnsAt + rows * (2 * sizeof(int64_t) + sizeof(Timestamp) + sizeof(uint32_t) + 1);
+        if (header.dictBytes % 8 != 0 || header.dictBytes > data.size() || needed > data.size()) {
+            throw std::runtime_error("truncated snapshot");
+        }
+
+        std::vector<ProductId> names =
+            ProductDictionary::parse(data.substr(sizeof(Header), header.dictBytes), header.products);
+
+        const char* column = data.data() + columnsAt;
+        const Timestamp* timestamps = reinterpret_cast<const Timestamp*>(column);
+        const int64_t* prices = reinterpret_cast<const int64_t*>(column + rows * sizeof(Timestamp));
+        const int64_t* amounts = prices + rows;
+        const uint32_t* productIds = reinterpret_cast<const uint32_t*>(amounts + rows);
+        const uint8_t* sides = reinterpret_cast<const uint8_t*>(productIds + rows);
+
+        OrderRows entries;
+        entries.reserve(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            if (productIds[i] >= names.size() || sides[i] > static_cast<uint8_t>(OrderBookType::bidsale)) {
+                throw std::runtime_error("corrupt snapshot row");
+            }
+            entries.emplace_back(Price::fromUnits(prices[i]), Quantity::fromUnits(amounts[i]), timestamps[i],
+                                 names[productIds[i]], static_cast<OrderBookType>(sides[i]));
+        }
+        std::cout << "SnapshotFile::read read " << entries.size() << " entries" << std::endl;
+        return entries;
+    }
+
+private:
+    static constexpr char kMagic[4] = {'O', 'B', 'K', '1'};
+    static constexpr uint32_t kVersion = 2; // 1 stored prices and amounts as f64
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t rows;
+        uint32_t products;
+        uint32_t reserved;
+        uint64_t dictBytes;
+    };
+    static_assert(sizeof(Header) % 8 == 0, "columns must stay 8-byte aligned");
+
+    template <typename Fn>
+    static void writeColumn(std::ofstream& out, const OrderRows& entries, Fn field) {
+        using T = decltype(field(entries[0]));
+        std::vector<T> column;
+        column.reserve(entries.size());
+        for (const OrderBookEntry& e : entries) column.push_back(field(e));
+        out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    }
+};
+
+// Block-compressed order archive (.obz) for cold storage. Layout:
+//   Header | product dictionary | Block*
+// Each block holds up to kBlockRows rows behind a BlockHeader recording its
+// row count, payload size and time range, so readers can skip whole blocks.
+// The payload stores, in order:
+//   timestamps  run-length encoded: (zigzag delta from previous run, length)
+//   product ids run-length encoded: (id, length)
+//   sides       run-length encoded: (side, length)
+//   prices      zigzag varint deltas of 1e-8 units
+//   amounts     the same as prices
+// Every integer is a LEB128 varint.
+class ArchiveFile {
 public:
-    static std::vector<std::string> tokenise(std::string csvLine, char separator) {
-        std::vector<std::string> tokens;
-        signed int start, end;
-        std::string token;
-        start = csvLine.find_first_not_of(separator, 0);
-        do {
-            end = csvLine.find_first_of(separator, start);
-            if (start == csvLine.length() || start == end) break;
-            if (end >= 0) token = csvLine.substr(start, end - start);
-            else token = csvLine.substr(start, csvLine.length() - start);
-            tokens.push_back(token);
-            start = end + 1;
-        } while (end > 0);
-        return tokens;
+    static bool isArchive(std::string_view data) {
+        return data.size() >= sizeof(Header) && std::memcmp(data.data(), kMagic, 4) == 0;
+    }
+
+    static void write(const std::string& filename, const OrderRows& entries) {
+        ProductDictionary products;
+        std::vector<uint32_t> productIds;
+        productIds.reserve(entries.size());
+        for (const OrderBookEntry& e : entries) productIds.push_back(products.idOf(e.product));
+        std::string dict = products.serialise();
+
+        Header header{};
+        std::memcpy(header.magic, kMagic, 4);
+        header.version = kVersion;
+        header.rows = entries.size();
+        header.products = products.size();
+        header.blocks = static_cast<uint32_t>((entries.size() + kBlockRows - 1) / kBlockRows);
+        header.dictBytes = dict.size();
+
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("cannot create " + filename);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(dict.data(), dict.size());
+        std::string payload;
+        for (size_t first = 0; first < entries.size(); first += kBlockRows) {
+            size_t last = std::min(first + kBlockRows, entries.size());
+            BlockHeader block{};
+            block.rows = static_cast<uint32_t>(last - first);
+            block.firstTimestamp = entries[first].timestamp;
+            block.lastTimestamp = entries[last - 1].timestamp;
+            payload.clear();
+            encodeRuns(payload, first, last, [&](size_t i) { return entries[i].timestamp; }, true);
+            encodeRuns(payload, first, last, [&](size_t i) { return static_cast<int64_t>(productIds[i]); }, false);
+            encodeRuns(payload, first, last, [&](size_t i) { return static_cast<int64_t>(entries[i].orderType); }, false);
+            encodeDeltas(payload, first, last, [&](size_t i) { return entries[i].price.units(); });
+            encodeDeltas(payload, first, last, [&](size_t i) { return entries[i].amount.units(); });
+            block.bytes = static_cast<uint32_t>(payload.size());
+            out.write(reinterpret_cast<const char*>(&block), sizeof(block));
+            out.write(payload.data(), payload.size());
+        }
+        if (!out) throw std::runtime_error("cannot write " + filename);
+    }
+
+    // Decodes a mapped archive image block by block.
+    static OrderRows read(std::string_view data) {
+        if (!isArchive(data)) throw std::runtime_error("not an order archive");
+        Header header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.version != kVersion) throw std::runtime_error("unsupported archive version");
+        if (header.dictBytes > data.size() - sizeof(Header)) throw std::runtime_error("truncated archive");
+        std::vector<ProductId> names =
+            ProductDictionary::parse(data.substr(sizeof(Header), header.dictBytes), header.products);
+
+        OrderRows entries;
+        entries.reserve(std::min<uint64_t>(header.rows, data.size()));
+        std::vector<int64_t> timestamps, productIds, sides, prices, amounts;
+        size_t pos = sizeof(Header) + header.dictBytes;
+        for (uint32_t b = 0; b < header.blocks; ++b) {
+            BlockHeader block;
+            if (data.size() - pos < sizeof(block)) throw std::runtime_error("truncated archive");
+            std::memcpy(&block, data.data() + pos, sizeof(block));
+            pos += sizeof(block);
+            if (data.size() - pos < block.bytes) throw std::runtime_error("truncated archive");
+            Decoder in{reinterpret_cast<const uint8_t*>(data.data() + pos),
+                       reinterpret_cast<const uint8_t*>(data.data() + pos + block.bytes)};
+            pos += block.bytes;
+
+            decodeRuns(in, block.rows, timestamps, true);
+            decodeRuns(in, block.rows, productIds, false);
+            decodeRuns(in, block.rows, sides, false);
+            decodeDeltas(in, block.rows, prices);
+            decodeDeltas(in, block.rows, amounts);
+            for (uint32_t i = 0; i < block.rows; ++i) {
+                if (productIds[i] < 0 || static_cast<uint64_t>(productIds[i]) >= names.size() ||
+                    sides[i] < 0 || sides[i] > static_cast<int64_t>(OrderBookType::bidsale)) {
+                    throw std::runtime_error("corrupt archive row");
+                }
+                entries.emplace_back(Price::fromUnits(prices[i]), Quantity::fromUnits(amounts[i]), timestamps[i],
+                                     names[productIds[i]], static_cast<OrderBookType>(sides[i]));
+            }
+        }
+        std::cout << "ArchiveFile::read read " << entries.size() << " entries" << std::endl;
+        return entries;
+    }
+
+private:
+    static constexpr char kMagic[4] = {'O', 'B', 'Z', '1'};
+    static constexpr uint32_t kVersion = 2; // 1 could hold raw f64 prices and amounts
+    static constexpr size_t kBlockRows = 1 << 16;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t rows;
+        uint32_t products;
+        uint32_t blocks;
+        uint64_t dictBytes;
+    };
+
+    struct BlockHeader {
+        uint32_t rows;
+        uint32_t bytes;
+        Timestamp firstTimestamp;
+        Timestamp lastTimestamp;
+    };
+
+    struct Decoder {
+        const uint8_t* p;
+        const uint8_t* end;
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (p == end) throw std::runtime_error("corrupt archive block");
+                uint8_t byte = *p++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            throw std::runtime_error("corrupt archive block");
+        }
+
+        int64_t zigzag() {
+            uint64_t v = varint();
+            return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+        }
+    };
+
+    static void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void putZigzag(std::string& out, int64_t value) {
+        putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    // Writes the run count, then (value, length) per run. With delta set the
+    // value is stored relative to the previous run's value.
+    template <typename Fn>
+    static void encodeRuns(std::string& out, size_t first, size_t last, Fn value, bool delta) {
+        std::vector<std::pair<int64_t, uint64_t>> runs;
+        for (size_t i = first; i < last; ++i) {
+            if (runs.empty() || runs.back().first != value(i)) runs.emplace_back(value(i), 0);
+            ++runs.back().second;
+        }
+        putVarint(out, runs.size());
+        int64_t previous = 0;
+        for (auto [v, length] : runs) {
+            if (delta) {
+                putZigzag(out, v - previous);
+                previous = v;
+            } else {
+                putVarint(out, static_cast<uint64_t>(v));
+            }
+            putVarint(out, length);
+        }
+    }
+
+    static void decodeRuns(Decoder& in, uint32_t rows, std::vector<int64_t>& values, bool delta) {
+        values.clear();
+        uint64_t runs = in.varint();
+        int64_t previous = 0;
+        for (uint64_t r = 0; r < runs; ++r) {
+            int64_t v = delta ? previous + in.zigzag() : static_cast<int64_t>(in.varint());
+            previous = v;
+            uint64_t length = in.varint();
+            if (length > rows - values.size()) throw std::runtime_error("corrupt archive block");
+            values.insert(values.end(), length, v);
+        }
+        if (values.size() != rows) throw std::runtime_error("corrupt archive block");
+    }
+
+    // Stores the column as zigzag varint deltas from the previous row.
+    template <typename Fn>
+    static void encodeDeltas(std::string& out, size_t first, size_t last, Fn value) {
+        int64_t previous = 0;
+        for (size_t i = first; i < last; ++i) {
+            putZigzag(out, value(i) - previous);
+            previous = value(i);
+        }
+    }
+
+    static void decodeDeltas(Decoder& in, uint32_t rows, std::vector<int64_t>& values) {
+        values.resize(rows);
+        int64_t previous = 0;
+        for (uint32_t i = 0; i < rows; ++i) {
+            previous += in.zigzag();
+            values[i] = previous;
+        }
     }
 };
 
 // ==========================================
-// 3. Wallet Class
+// 4. Wallet Class
 // ==========================================
 
 class Wallet {
 public:
     Wallet() {}
     
-    void insertCurrency(std::string type, double amount) {
-        double balance;
-        if (amount < 0) throw std::exception();
-        if (currencies.count(type) == 0) balance = 0;
+    void insertCurrency(CurrencyId type, Quantity amount) {
+        Quantity balance;
+        if (amount < Quantity{}) throw std::exception();
+        if (currencies.count(type) == 0) balance = Quantity{};
         else balance = currencies[type];
         balance += amount;
         currencies[type] = balance;
     }
 
-    bool removeCurrency(std::string type, double amount) {
-        if (amount < 0) return false;
+    bool removeCurrency(CurrencyId type, Quantity amount) {
+        if (amount < Quantity{}) return false;
         if (currencies.count(type) == 0) return false;
         if (containsCurrency(type, amount)) {
             currencies[type] -= amount;
@@ -100,108 +2124,329 @@ public:
         return false;
     }
 
-    bool containsCurrency(std::string type, double amount) {
+    bool containsCurrency(CurrencyId type, Quantity amount) {
         if (currencies.count(type) == 0) return false;
         return currencies[type] >= amount;
     }
 
     std::string toString() {
+        std::map<std::string, Quantity> byName;
+        for (std::pair<CurrencyId, Quantity> pair : currencies) {
+            byName[Symbols::currencyName(pair.first)] = pair.second;
+        }
         std::string s;
-        for (std::pair<std::string, double> pair : currencies) {
+        for (std::pair<std::string, Quantity> pair : byName) {
             std::string currency = pair.first;
-            double amount = pair.second;
-            s += currency + " : " + std::to_string(amount) + "\n";
+            Quantity amount = pair.second;
+            s += currency + " : " + std::to_string(amount.toDouble()) + "\n";
         }
         return s;
     }
 
-private:
-    std::map<std::string, double> currencies;
+protected:
+    std::map<CurrencyId, Quantity> currencies;
 };
 
 // ==========================================
-// 4. OrderBook Class
+// 5. OrderBook Class
 // ==========================================
 
-class OrderBook {
+// Identifies an order in an OrderPool: the slot index in the low 32 bits and
+// the slot's generation in the high 32.
+using OrderHandle = uint64_t;
+
+// Slab of live orders addressed by handles. Insert, lookup, cancel and amend are
+// constant time. A cancelled order's slot goes on a free list and is reused
+// by the next insert. Its generation is bumped, so old handles to the slot
+// stop resolving.
+class OrderPool {
 public:
-    OrderBook() {
-        // MOCK DATA LOADING (Since we don't have the external CSV file)
-        // Format: Price, Amount, Timestamp, Product, Type
-        orders.emplace_back(10000, 0.5, "2020/03/17 17:01:24", "BTC/USDT", OrderBookType::bid);
-        orders.emplace_back(10500, 0.2, "2020/03/17 17:01:24", "BTC/USDT", OrderBookType::ask);
-        orders.emplace_back(10100, 1.0, "2020/03/17 17:01:24", "BTC/USDT", OrderBookType::bid);
-        
-        // Next time frame
-        orders.emplace_back(200, 50, "2020/03/17 17:01:30", "ETH/USDT", OrderBookType::ask);
-        orders.emplace_back(190, 10, "2020/03/17 17:01:30", "ETH/USDT", OrderBookType::bid);
+    OrderHandle insert(const OrderBookEntry& order) {
+        uint32_t index;
+        if (freeHead != kNoSlot) {
+            index = freeHead;
+            freeHead = slots[index].nextFree;
+            slots[index].order = order;
+        } else {
+            if (slots.size() == kNoSlot) throw std::runtime_error("order pool is full");
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot{order, 0, kNoSlot, false});
+        }
+        slots[index].live = true;
+        ++liveCount;
+        return static_cast<OrderHandle>(slots[index].generation) << 32 | index;
+    }
+
+    // The live order behind handle, or null if it was cancelled or never issued
+    const OrderBookEntry* find(OrderHandle handle) const {
+        const Slot* slot = resolve(handle);
+        return slot ? &slot->order : nullptr;
+    }
+
+    bool cancel(OrderHandle handle) {
+        Slot* slot = const_cast<Slot*>(resolve(handle));
+        if (!slot) return false;
+        uint32_t index = static_cast<uint32_t>(handle);
+        slot->live = false;
+        ++slot->generation;
+        slot->nextFree = freeHead;
+        freeHead = index;
+        --liveCount;
+        return true;
+    }
+
+    bool amend(OrderHandle handle, Price price, Quantity amount) {
+        Slot* slot = const_cast<Slot*>(resolve(handle));
+        if (!slot) return false;
+        slot->order.price = price;
+        slot->order.amount = amount;
+        return true;
+    }
+
+    size_t size() const { return liveCount; }
+
+private:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    struct Slot {
+        OrderBookEntry order;
+        uint32_t generation;
+        uint32_t nextFree; // next slot on the free list while not live
+        bool live;
+    };
+
+    std::vector<Slot> slots;
+    uint32_t freeHead = kNoSlot;
+    size_t liveCount = 0;
+
+    const Slot* resolve(OrderHandle handle) const {
+        uint32_t index = static_cast<uint32_t>(handle);
+        if (index >= slots.size()) return nullptr;
+        const Slot& slot = slots[index];
+        if (!slot.live || slot.generation != static_cast<uint32_t>(handle >> 32)) return nullptr;
+        return &slot;
     }
+};
 
-    std::vector<std::string> getKnownProducts() {
-        std::vector<std::string> products;
-        std::map<std::string, bool> prodMap;
-        for (OrderBookEntry& e : orders) {
-            prodMap[e.product] = true;
+class OrderBook {
+public:
+    // Loads the dataset by mapping the file: snapshots are read column by
+    // column, CSV is parsed in place on all hardware threads when threads is 0.
+    // With follow set the CSV stays open after its last complete line and
+    // rows appended later are picked up by poll(). Rows before from are
+    // skipped; for CSV the seek index finds where they end without parsing.
+    OrderBook(std::string filename, unsigned threads = 0, bool follow = false,
+              Timestamp from = std::numeric_limits<Timestamp>::min()) {
+        MappedFile file(filename);
+        std::string_view data = file.view();
+        bool csv = !SnapshotFile::isSnapshot(data) && !ArchiveFile::isArchive(data);
+        if (follow) {
+            if (!csv) throw std::runtime_error("only CSV datasets can be followed");
+            data = data.substr(0, data.rfind('\n') + 1); // a partial last line is read later
+            stream = std::make_unique<CSVStream>(filename, data.size(), true);
         }
-        for (auto const& [key, val] : prodMap) {
-            products.push_back(key);
+        if (csv && from > std::numeric_limits<Timestamp>::min()) {
+            data.remove_prefix(std::min<uint64_t>(SeekIndex::seek(filename, from), data.size()));
         }
+        file.willNeed(data);
+        orders.append(loadOrders(data, threads));
+        // binary formats, or a CSV the index could not seek in, still hold earlier rows
+        orders.eraseBefore(from);
+        if (orders.empty()) throw std::runtime_error("no orders in " + filename);
+        for (size_t i = 0; i < orders.size(); ++i) observe(orders.product[i], orders.price[i], orders.amount[i]);
+    }
+
+    // Streams the dataset instead: only windowSize distinct timestamps, plus
+    // the first row of the one after, are held in memory at any time. The
+    // stream must be in timestamp order; rows that go back in time are dropped.
+    OrderBook(std::unique_ptr<OrderSource> _stream, size_t _windowSize)
+    : stream(std::move(_stream)), windowSize(std::max<size_t>(_windowSize, 1)), streaming(true) {
+        refill();
+        if (orders.empty()) throw std::runtime_error("no orders in stream");
+    }
+
+    static OrderRows loadOrders(std::string_view data, unsigned threads = 0) {
+        if (SnapshotFile::isSnapshot(data)) return SnapshotFile::read(data);
+        if (ArchiveFile::isArchive(data)) return ArchiveFile::read(data);
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        return CSVReader::readCSV(data, threads);
+    }
+
+    // Products with rows or user orders in the book, ordered by name. Kept
+    // up to date as orders come and go; valid until the book next changes.
+    const std::vector<ProductId>& getKnownProducts() const {
         return products;
     }
 
-    std::vector<OrderBookEntry> getOrders(OrderBookType type, std::string product, std::string timestamp) {
-        std::vector<OrderBookEntry> orders_sub;
-        for (OrderBookEntry& e : orders) {
-            if (e.orderType == type && e.product == product && e.timestamp == timestamp) {
-                orders_sub.push_back(e);
-            }
+    // The book's rows for one timestamp, product and side, in place. User
+    // orders are not included; see getUserOrders.
+    OrderSpan getOrders(OrderBookType type, ProductId product, Timestamp timestamp) const {
+        return OrderSpan(orders, orders.find(timestamp, product, type));
+    }
+
+    // Live user orders with the same keys; the refs are valid until the
+    // orders are next changed
+    std::pmr::vector<OrderRef> getUserOrders(OrderBookType type, ProductId product, Timestamp timestamp,
+                                             std::pmr::memory_resource* memory = std::pmr::get_default_resource()) const {
+        std::pmr::vector<OrderRef> matches(memory);
+        auto placed = userByTime.find(timestamp);
+        if (placed == userByTime.end()) return matches;
+        for (OrderHandle handle : placed->second) {
+            const OrderBookEntry* e = userOrders.find(handle);
+            if (e && e->product == product && e->orderType == type) matches.emplace_back(*e);
         }
-        return orders_sub;
+        return matches;
     }
 
-    double getHighPrice(std::vector<OrderBookEntry>& orders) {
-        double max = orders[0].price;
-        for (OrderBookEntry& e : orders) {
-            if (e.price > max) max = e.price;
+    // Tick and lot size of product inferred from the rows loaded so far; a
+    // product with no rows can trade in any step of 10^-8.
+    ProductScale getScale(ProductId product) const {
+        if (product < scales.size() && seen[product]) return scales[product];
+        return ProductScale{Price::fromUnits(1), Quantity::fromUnits(1)};
+    }
+
+    Price getHighPrice(const OrderSpan& orders) {
+        const Price* prices = orders.prices();
+        Price max = prices[0];
+        for (size_t i = 1; i < orders.size(); ++i) {
+            if (prices[i] > max) max = prices[i];
         }
         return max;
     }
 
-    double getLowPrice(std::vector<OrderBookEntry>& orders) {
-        double min = orders[0].price;
-        for (OrderBookEntry& e : orders) {
-            if (e.price < min) min = e.price;
+    Price getLowPrice(const OrderSpan& orders) {
+        const Price* prices = orders.prices();
+        Price min = prices[0];
+        for (size_t i = 1; i < orders.size(); ++i) {
+            if (prices[i] < min) min = prices[i];
         }
         return min;
     }
 
-    std::string getEarliestTime() {
-        return orders[0].timestamp;
+    Timestamp getEarliestTime() {
+        cursor = 0;
+        return orders.times().front();
     }
 
-    std::string getNextTime(std::string timestamp) {
-        std::string next_timestamp = "";
-        for (OrderBookEntry& e : orders) {
-            if (e.timestamp > timestamp) {
-                next_timestamp = e.timestamp;
-                break;
+    // Steps through the calendar of distinct timestamps. Stepping on from the
+    // time returned last is an index increment; from any other time the next
+    // one is found by binary search.
+    Timestamp getNextTime(Timestamp timestamp) {
+        const Column<Timestamp>& times = orders.times();
+        size_t next;
+        if (cursor < times.size() && times[cursor] == timestamp) next = cursor + 1;
+        else next = std::upper_bound(times.begin(), times.end(), timestamp) - times.begin();
+        if (next < times.size()) {
+            cursor = next;
+            return times[next];
+        }
+        if (stream) return timestamp; // more rows may still arrive
+        cursor = 0;
+        return times[0]; // Wrap around
+    }
+
+    // Adds a user order. It stays in the book, and is matched whenever the
+    // replay reaches its timestamp, until it is cancelled or a streamed book
+    // advances past it.
+    OrderHandle insertOrder(const OrderBookEntry& order) {
+        OrderHandle handle = userOrders.insert(order);
+        place(handle, userByTime.try_emplace(order.timestamp).first);
+        addProductRow(order.product);
+        return handle;
+    }
+
+    // Adds a batch of user orders, returning their handles in batch order.
+    // The batch is sorted by time once, so each distinct timestamp costs a
+    // single index lookup however many orders share it.
+    std::vector<OrderHandle> insertOrders(const OrderRows& batch) {
+        std::vector<OrderHandle> handles(batch.size());
+        std::vector<size_t> byTime(batch.size());
+        std::iota(byTime.begin(), byTime.end(), 0);
+        std::stable_sort(byTime.begin(), byTime.end(),
+                         [&](size_t a, size_t b) { return batch[a].timestamp < batch[b].timestamp; });
+        UserIndex::iterator placed;
+        for (size_t k = 0; k < byTime.size(); ++k) {
+            const OrderBookEntry& order = batch[byTime[k]];
+            if (k == 0 || order.timestamp != batch[byTime[k - 1]].timestamp) {
+                placed = userByTime.try_emplace(order.timestamp).first;
             }
+            handles[byTime[k]] = userOrders.insert(order);
+            place(handles[byTime[k]], placed);
+            addProductRow(order.product);
         }
-        if (next_timestamp == "") {
-            next_timestamp = orders[0].timestamp; // Wrap around
+        return handles;
+    }
+
+    const OrderBookEntry* findOrder(OrderHandle handle) const {
+        return userOrders.find(handle);
+    }
+
+    // Removes the order and its entry in the time index in constant time:
+    // the last handle at its timestamp moves into the gap.
+    bool cancelOrder(OrderHandle handle) {
+        const OrderBookEntry* order = userOrders.find(handle);
+        if (!order) return false;
+        Placement& p = placements[static_cast<uint32_t>(handle)];
+        std::vector<OrderHandle>& handles = p.list->second;
+        handles[p.position] = handles.back();
+        placements[static_cast<uint32_t>(handles.back())].position = p.position;
+        handles.pop_back();
+        if (handles.empty()) userByTime.erase(p.list);
+        removeProductRow(order->product);
+        return userOrders.cancel(handle);
+    }
+
+    bool amendOrder(OrderHandle handle, Price price, Quantity amount) {
+        return userOrders.amend(handle, price, amount);
+    }
+
+    // Lets a streamed book drop the rows before timestamp and parse ahead to
+    // refill its window. A fully loaded book keeps everything.
+    void advanceTo(Timestamp timestamp) {
+        if (!streaming) return;
+        size_t erased = orders.rowsBefore(timestamp);
+        for (size_t i = 0; i < erased; ++i) removeProductRow(orders.product[i]);
+        orders.eraseBefore(timestamp);
+        auto expired = userByTime.lower_bound(timestamp);
+        for (auto it = userByTime.begin(); it != expired; ++it) {
+            for (OrderHandle handle : it->second) {
+                if (const OrderBookEntry* e = userOrders.find(handle)) {
+                    removeProductRow(e->product);
+                    userOrders.cancel(handle);
+                }
+            }
         }
-        return next_timestamp;
+        userByTime.erase(userByTime.begin(), expired);
+        cursor = 0; // timestamp now starts the calendar
+        refill();
     }
 
-    void insertOrder(OrderBookEntry& order) {
-        orders.push_back(order);
-        std::sort(orders.begin(), orders.end(), OrderBookEntry::compareByTimestamp);
+    // Picks up rows appended to a followed file since the last call, parsing
+    // only the new bytes. Does nothing unless the book follows its file.
+    void poll() {
+        if (!stream) return;
+        if (streaming) {
+            refill();
+            return;
+        }
+        incoming.clear();
+        while (stream->next(incoming)) {}
+        for (const OrderBookEntry& e : incoming) observe(e.product, e.price, e.amount);
+        orders.merge(incoming);
     }
 
-    std::vector<OrderBookEntry> matchAsksToBids(std::string product, std::string timestamp) {
-        std::vector<OrderBookEntry> asks = getOrders(OrderBookType::ask, product, timestamp);
-        std::vector<OrderBookEntry> bids = getOrders(OrderBookType::bid, product, timestamp);
-        std::vector<OrderBookEntry> sales;
+    // Matches the product's asks and bids at timestamp. The sales and every
+    // temporary are allocated from memory.
+    std::pmr::vector<OrderBookEntry> matchAsksToBids(ProductId product, Timestamp timestamp,
+                                                     std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        std::pmr::vector<OrderBookEntry> asks(memory);
+        std::pmr::vector<OrderBookEntry> bids(memory);
+        std::pmr::vector<OrderBookEntry> sales(memory);
+        // matching consumes amounts, so it works on copies of the rows
+        for (OrderRef r : getOrders(OrderBookType::ask, product, timestamp)) asks.push_back(r.entry());
+        for (OrderRef r : getUserOrders(OrderBookType::ask, product, timestamp, memory)) asks.push_back(r.entry());
+        for (OrderRef r : getOrders(OrderBookType::bid, product, timestamp)) bids.push_back(r.entry());
+        for (OrderRef r : getUserOrders(OrderBookType::bid, product, timestamp, memory)) bids.push_back(r.entry());
 
         std::sort(asks.begin(), asks.end(), OrderBookEntry::compareByPriceAsc);
         std::sort(bids.begin(), bids.end(), OrderBookEntry::compareByPriceDesc);
@@ -209,21 +2454,21 @@ public:
         for (OrderBookEntry& ask : asks) {
             for (OrderBookEntry& bid : bids) {
                 if (bid.price >= ask.price) {
-                    OrderBookEntry sale{ask.price, 0, timestamp, product, OrderBookType::asksale};
+                    OrderBookEntry sale{ask.price, Quantity{}, timestamp, product, OrderBookType::asksale};
                     
-                    if (bid.username == "simuser") {
-                        sale.username = "simuser";
+                    if (bid.account != Accounts::dataset) {
+                        sale.account = bid.account;
                         sale.orderType = OrderBookType::bidsale;
                     }
-                    if (ask.username == "simuser") {
-                        sale.username = "simuser";
+                    if (ask.account != Accounts::dataset) {
+                        sale.account = ask.account;
                         sale.orderType = OrderBookType::asksale;
                     }
 
                     if (bid.amount == ask.amount) {
                         sale.amount = ask.amount;
                         sales.push_back(sale);
-                        bid.amount = 0;
+                        bid.amount = Quantity{};
                         break;
                     }
                     if (bid.amount > ask.amount) {
@@ -232,11 +2477,11 @@ public:
                         bid.amount = bid.amount - ask.amount;
                         break;
                     }
-                    if (bid.amount < ask.amount && bid.amount > 0) {
+                    if (bid.amount < ask.amount && bid.amount > Quantity{}) {
                         sale.amount = bid.amount;
                         sales.push_back(sale);
                         ask.amount = ask.amount - bid.amount;
-                        bid.amount = 0;
+                        bid.amount = Quantity{};
                         continue;
                     }
                 }
@@ -246,24 +2491,102 @@ public:
     }
 
 private:
-    std::vector<OrderBookEntry> orders;
+    OrderStore orders;
+    OrderPool userOrders;
+    // handles of live user orders by timestamp. Cancelling swaps the last
+    // handle of a timestamp into the gap, so their order there is not kept;
+    // matching sorts by price anyway.
+    using UserIndex = std::map<Timestamp, std::vector<OrderHandle>>;
+    UserIndex userByTime;
+    // where each pool slot's handle sits in userByTime, indexed by slot
+    struct Placement {
+        UserIndex::iterator list;
+        uint32_t position;
+    };
+    std::vector<Placement> placements;
+    size_t cursor = 0; // calendar index of the time getNextTime returned last
+    OrderRows incoming; // rows read from the stream, before they are stored
+    std::unique_ptr<OrderSource> stream; // null once exhausted, or when fully loaded
+    size_t windowSize = 0;
+    bool streaming = false;
+    size_t outOfOrder = 0;
+    std::vector<ProductScale> scales; // indexed by ProductId
+    std::vector<bool> seen;
+    std::vector<size_t> productRows; // rows and user orders per ProductId
+    std::vector<ProductId> products;  // those with any, ordered by name
+
+    // Records a row entering the store
+    void observe(ProductId product, Price price, Quantity amount) {
+        if (product >= scales.size()) {
+            scales.resize(product + 1);
+            seen.resize(product + 1);
+        }
+        scales[product].observe(price, amount);
+        seen[product] = true;
+        addProductRow(product);
+    }
+
+    // Appends a new user order's handle to its timestamp's list
+    void place(OrderHandle handle, UserIndex::iterator list) {
+        uint32_t slot = static_cast<uint32_t>(handle);
+        if (slot >= placements.size()) placements.resize(slot + 1);
+        placements[slot] = Placement{list, static_cast<uint32_t>(list->second.size())};
+        list->second.push_back(handle);
+    }
+
+    void addProductRow(ProductId product) {
+        if (product >= productRows.size()) productRows.resize(product + 1);
+        if (productRows[product]++ > 0) return;
+        auto byName = [](ProductId a, ProductId b) { return Symbols::productName(a) < Symbols::productName(b); };
+        products.insert(std::upper_bound(products.begin(), products.end(), product, byName), product);
+    }
+
+    void removeProductRow(ProductId product) {
+        if (--productRows[product] > 0) return;
+        products.erase(std::find(products.begin(), products.end(), product));
+    }
+
+    void refill() {
+        size_t times = orders.sliceCount();
+        while (stream && times <= windowSize) {
+            incoming.clear();
+            if (!stream->next(incoming)) {
+                if (!stream->exhausted()) break; // following: wait for the writer
+                std::cout << "End of stream";
+                if (stream->badRows() > 0) std::cout << " (" << stream->badRows() << " bad lines skipped)";
+                if (outOfOrder > 0) std::cout << " (" << outOfOrder << " out-of-order rows dropped)";
+                std::cout << std::endl;
+                stream.reset();
+                break;
+            }
+            for (const OrderBookEntry& e : incoming) {
+                if (!orders.empty() && e.timestamp < orders.timestamp.back()) {
+                    ++outOfOrder;
+                    continue;
+                }
+                if (orders.empty() || e.timestamp > orders.timestamp.back()) ++times;
+                observe(e.product, e.price, e.amount);
+                orders.push_back(e);
+            }
+        }
+    }
 };
 
 // ==========================================
-// 5. MerkelMain (The App Loop)
+// 6. MerkelMain (The App Loop)
 // ==========================================
 
 class MerkelMain {
 public:
-    MerkelMain() {}
+    MerkelMain(OrderBook book) : orderBook(std::move(book)) {}
 
     void init() {
         int input;
         currentTime = orderBook.getEarliestTime();
-        wallet.insertCurrency("BTC", 10);
-        wallet.insertCurrency("USDT", 100000); // Initial dummy money
+        wallet.insertCurrency(Symbols::currency("BTC"), Quantity::whole(10));
+        wallet.insertCurrency(Symbols::currency("USDT"), Quantity::whole(100000)); // Initial dummy money
 
-        while (true) {
+        while (std::cin) {
             printMenu();
             input = getUserOption();
             processUserOption(input);
@@ -274,7 +2597,7 @@ private:
     void printMenu() {
         std::cout << "\n========================================" << std::endl;
         std::cout << "MERKEL REX TRADING PLATFORM" << std::endl;
-        std::cout << "Current Time: " << currentTime << std::endl;
+        std::cout << "Current Time: " << CSVReader::formatTimestamp(currentTime) << std::endl;
         std::cout << "========================================" << std::endl;
         std::cout << "1: Print help" << std::endl;
         std::cout << "2: Print exchange stats" << std::endl;
@@ -282,19 +2605,17 @@ private:
         std::cout << "4: Make a bid (Buy)" << std::endl;
         std::cout << "5: Print wallet" << std::endl;
         std::cout << "6: Continue (Next Time Step)" << std::endl;
+        std::cout << "7: Cancel an order" << std::endl;
+        std::cout << "8: Amend an order" << std::endl;
         std::cout << "========================================" << std::endl;
-        std::cout << "Type in 1-6: ";
+        std::cout << "Type in 1-8: ";
     }
 
     int getUserOption() {
         int userOption = 0;
         std::string line;
         std::getline(std::cin, line);
-        try {
-            userOption = std::stoi(line);
-        } catch (const std::exception& e) {
-            // Invalid input
-        }
+        if (CSVReader::parseInt(line, userOption) != std::errc()) userOption = 0; // Invalid input
         return userOption;
     }
 
@@ -306,6 +2627,8 @@ private:
         if (userOption == 4) enterBid();
         if (userOption == 5) printWallet();
         if (userOption == 6) gotoNextTimeframe();
+        if (userOption == 7) cancelOrder();
+        if (userOption == 8) amendOrder();
     }
 
     void printHelp() {
@@ -313,17 +2636,25 @@ private:
     }
 
     void printMarketStats() {
-        for (std::string const& p : orderBook.getKnownProducts()) {
-            std::cout << "Product: " << p << std::endl;
-            std::vector<OrderBookEntry> entries = orderBook.getOrders(OrderBookType::ask, p, currentTime);
-            if (!entries.empty()) {
-                std::cout << "  Asks seen: " << entries.size() << std::endl;
-                std::cout << "  Max ask: " << orderBook.getHighPrice(entries) << std::endl;
-                std::cout << "  Min ask: " << orderBook.getLowPrice(entries) << std::endl;
+        for (ProductId p : orderBook.getKnownProducts()) {
+            std::cout << "Product: " << Symbols::productName(p) << std::endl;
+            OrderSpan entries = orderBook.getOrders(OrderBookType::ask, p, currentTime);
+            std::pmr::vector<OrderRef> own = orderBook.getUserOrders(OrderBookType::ask, p, currentTime, &stepArena);
+            if (!entries.empty() || !own.empty()) {
+                Price high = entries.empty() ? own[0].price() : orderBook.getHighPrice(entries);
+                Price low = entries.empty() ? own[0].price() : orderBook.getLowPrice(entries);
+                for (const OrderRef& r : own) {
+                    high = std::max(high, r.price());
+                    low = std::min(low, r.price());
+                }
+                std::cout << "  Asks seen: " << entries.size() + own.size() << std::endl;
+                std::cout << "  Max ask: " << high << std::endl;
+                std::cout << "  Min ask: " << low << std::endl;
             } else {
                 std::cout << "  No Asks" << std::endl;
             }
         }
+        stepArena.reset();
     }
 
     void enterAsk() {
@@ -331,21 +2662,21 @@ private:
         std::string input;
         std::getline(std::cin, input);
         
-        std::vector<std::string> tokens = CSVReader::tokenise(input, ',');
-        if (tokens.size() != 3) {
+        Price price;
+        Quantity amount;
+        if (CSVReader::tokenise(input, ',', tokens) != 3 ||
+            CSVReader::parseDecimal(tokens[1], price) != std::errc() ||
+            CSVReader::parseDecimal(tokens[2], amount) != std::errc()) {
             std::cout << "Bad input!" << std::endl;
         } else {
-            try {
-                OrderBookEntry obe{std::stod(tokens[1]), std::stod(tokens[2]), currentTime, tokens[0], OrderBookType::ask, "simuser"};
-                obe.username = "simuser";
-                if (wallet.canFulfillOrder(obe)) {
-                    std::cout << "Wallet looks good." << std::endl;
-                    orderBook.insertOrder(obe);
-                } else {
-                    std::cout << "Wallet has insufficient funds." << std::endl;
-                }
-            } catch (const std::exception& e) {
-                std::cout << "Bad input!" << std::endl;
+            OrderBookEntry obe{price, amount, currentTime, Symbols::product(tokens[0]), OrderBookType::ask, user};
+            if (!fitsScale(obe)) {
+                printScaleRejection(obe.product);
+            } else if (wallet.canFulfillOrder(obe)) {
+                std::cout << "Wallet looks good." << std::endl;
+                std::cout << "Order id: " << orderBook.insertOrder(obe) << std::endl;
+            } else {
+                std::cout << "Wallet has insufficient funds." << std::endl;
             }
         }
     }
@@ -355,92 +2686,241 @@ private:
         std::string input;
         std::getline(std::cin, input);
         
-        std::vector<std::string> tokens = CSVReader::tokenise(input, ',');
-        if (tokens.size() != 3) {
+        Price price;
+        Quantity amount;
+        if (CSVReader::tokenise(input, ',', tokens) != 3 ||
+            CSVReader::parseDecimal(tokens[1], price) != std::errc() ||
+            CSVReader::parseDecimal(tokens[2], amount) != std::errc()) {
             std::cout << "Bad input!" << std::endl;
         } else {
-            try {
-                OrderBookEntry obe{std::stod(tokens[1]), std::stod(tokens[2]), currentTime, tokens[0], OrderBookType::bid, "simuser"};
-                if (wallet.canFulfillOrder(obe)) {
-                    std::cout << "Wallet looks good." << std::endl;
-                    orderBook.insertOrder(obe);
-                } else {
-                    std::cout << "Wallet has insufficient funds." << std::endl;
-                }
-            } catch (const std::exception& e) {
-                std::cout << "Bad input!" << std::endl;
+            OrderBookEntry obe{price, amount, currentTime, Symbols::product(tokens[0]), OrderBookType::bid, user};
+            if (!fitsScale(obe)) {
+                printScaleRejection(obe.product);
+            } else if (wallet.canFulfillOrder(obe)) {
+                std::cout << "Wallet looks good." << std::endl;
+                std::cout << "Order id: " << orderBook.insertOrder(obe) << std::endl;
+            } else {
+                std::cout << "Wallet has insufficient funds." << std::endl;
             }
         }
     }
 
+    void cancelOrder() {
+        std::cout << "Cancel an order - enter the order id" << std::endl;
+        std::string input;
+        std::getline(std::cin, input);
+
+        OrderHandle handle;
+        if (CSVReader::parseInt(input, handle) != std::errc()) {
+            std::cout << "Bad input!" << std::endl;
+        } else if (orderBook.cancelOrder(handle)) {
+            std::cout << "Order " << handle << " cancelled." << std::endl;
+        } else {
+            std::cout << "No open order " << handle << "." << std::endl;
+        }
+    }
+
+    void amendOrder() {
+        std::cout << "Amend an order - enter: id,price,amount, eg 0,200,0.5" << std::endl;
+        std::string input;
+        std::getline(std::cin, input);
+
+        OrderHandle handle;
+        Price price;
+        Quantity amount;
+        if (CSVReader::tokenise(input, ',', tokens) != 3 ||
+            CSVReader::parseInt(tokens[0], handle) != std::errc() ||
+            CSVReader::parseDecimal(tokens[1], price) != std::errc() ||
+            CSVReader::parseDecimal(tokens[2], amount) != std::errc()) {
+            std::cout << "Bad input!" << std::endl;
+            return;
+        }
+        const OrderBookEntry* order = orderBook.findOrder(handle);
+        if (!order) {
+            std::cout << "No open order " << handle << "." << std::endl;
+            return;
+        }
+        OrderBookEntry amended = *order;
+        amended.price = price;
+        amended.amount = amount;
+        if (!fitsScale(amended)) {
+            printScaleRejection(amended.product);
+        } else if (wallet.canFulfillOrder(amended)) {
+            orderBook.amendOrder(handle, price, amount);
+            std::cout << "Order " << handle << " amended." << std::endl;
+        } else {
+            std::cout << "Wallet has insufficient funds." << std::endl;
+        }
+    }
+
+    // Whether the order's price and amount are whole ticks and lots
+    bool fitsScale(const OrderBookEntry& order) {
+        ProductScale scale = orderBook.getScale(order.product);
+        return order.price.units() % scale.tick.units() == 0 && order.amount.units() % scale.lot.units() == 0;
+    }
+
+    // Tell the user which ticks and lots the product trades in
+    void printScaleRejection(ProductId product) {
+        ProductScale scale = orderBook.getScale(product);
+        std::cout << "Bad input! " << Symbols::productName(product) << " prices move in steps of " << scale.tick
+                  << ", amounts in steps of " << scale.lot << std::endl;
+    }
+
     void printWallet() {
         std::cout << wallet.toString() << std::endl;
     }
 
     void gotoNextTimeframe() {
         std::cout << "Going to next time frame..." << std::endl;
-        for (std::string& p : orderBook.getKnownProducts()) {
-            std::cout << "Matching " << p << std::endl;
-            std::vector<OrderBookEntry> sales = orderBook.matchAsksToBids(p, currentTime);
-            std::cout << "Sales: " << sales.size() << std::endl;
-            for (OrderBookEntry& sale : sales) {
-                std::cout << "Sale price: " << sale.price << " amount " << sale.amount << std::endl;
-                if (sale.username == "simuser") {
-                    wallet.processSale(sale);
+        orderBook.poll();
+        // a streamed book waiting at its newest time returns that time again;
+        // its orders were matched and settled on the step that reached it
+        if (currentTime != matchedTime) {
+            for (ProductId p : orderBook.getKnownProducts()) {
+                std::cout << "Matching " << Symbols::productName(p) << std::endl;
+                std::pmr::vector<OrderBookEntry> sales = orderBook.matchAsksToBids(p, currentTime, &stepArena);
+                std::cout << "Sales: " << sales.size() << std::endl;
+                for (OrderBookEntry& sale : sales) {
+                    std::cout << "Sale price: " << sale.price << " amount " << sale.amount << std::endl;
+                    if (sale.account == user) {
+                        wallet.processSale(sale);
+                    }
                 }
             }
+            matchedTime = currentTime;
         }
         currentTime = orderBook.getNextTime(currentTime);
+        orderBook.advanceTo(currentTime);
+        stepArena.reset();
     }
 
     // Extended Wallet helper to handle simulated checking/processing
     class ExtendedWallet : public Wallet {
     public:
         bool canFulfillOrder(OrderBookEntry order) {
-            std::vector<std::string> currs = CSVReader::tokenise(order.product, '/');
+            if (!Symbols::isPair(order.product)) return false;
             if (order.orderType == OrderBookType::ask) {
                 // To sell ETH, I need ETH
-                return containsCurrency(currs[0], order.amount);
+                return containsCurrency(Symbols::base(order.product), order.amount);
             }
             if (order.orderType == OrderBookType::bid) {
                 // To buy ETH for USDT, I need USDT
-                return containsCurrency(currs[1], order.amount * order.price);
+                return containsCurrency(Symbols::quote(order.product), notional(order.price, order.amount));
             }
             return false;
         }
 
         void processSale(OrderBookEntry& sale) {
-            std::vector<std::string> currs = CSVReader::tokenise(sale.product, '/');
+            CurrencyId base = Symbols::base(sale.product);
+            CurrencyId quote = Symbols::quote(sale.product);
             if (sale.orderType == OrderBookType::asksale) {
                 // You sold sold something
-                double outgoing = sale.amount;
-                double incoming = sale.amount * sale.price;
-                currencies[currs[0]] -= outgoing; // Sold ETH
-                currencies[currs[1]] += incoming; // Got USDT
+                Quantity outgoing = sale.amount;
+                Quantity incoming = notional(sale.price, sale.amount);
+                currencies[base] -= outgoing; // Sold ETH
+                currencies[quote] += incoming; // Got USDT
             }
             if (sale.orderType == OrderBookType::bidsale) {
                 // You bought something
-                double incoming = sale.amount;
-                double outgoing = sale.amount * sale.price;
-                currencies[currs[0]] += incoming; // Got ETH
-                currencies[currs[1]] -= outgoing; // Paid USDT
+                Quantity incoming = sale.amount;
+                Quantity outgoing = notional(sale.price, sale.amount);
+                currencies[base] += incoming; // Got ETH
+                currencies[quote] -= outgoing; // Paid USDT
             }
         }
-        // Need access to parent's map, usually done via protected but here using friend or structure change
-        // For single file simplicity, I will assume base class members are protected or handled here.
-        using Wallet::currencies; // Assumes currencies is protected in Wallet, let's fix Wallet visibility below
     } wallet;
-    
-    // Fix Wallet class visibility for this specific inheritance trick:
-    // Ideally, Wallet properties should be protected. 
-    // *I have updated the Wallet class below to make `currencies` protected for this to work.*
+
+    OrderBook orderBook;
+    Timestamp currentTime;
+    Timestamp matchedTime = std::numeric_limits<Timestamp>::min(); // last time whose orders were matched
+    AccountId user = Accounts::id("simuser");
+    std::vector<std::string_view> tokens; // reused tokenise buffer for user input
+    StepArena stepArena; // temporaries of the current menu action
 };
 
 // ==========================================
 // Main Entry Point
 // ==========================================
-int main() {
-    MerkelMain app;
-    app.init();
+int main(int argc, char* argv[]) {
+    std::string filename = "20200317.csv";
+    std::string convertTo;
+    unsigned threads = 0;
+    size_t window = 0;
+    bool follow = false;
+    std::string catalogDir;
+    std::string fromText, toText;
+    bool hugePages = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) threads = std::atoi(argv[++i]);
+        else if (arg == "--stream" && i + 1 < argc) window = std::atoi(argv[++i]);
+        else if (arg == "--follow") follow = true;
+        else if (arg == "--catalog" && i + 1 < argc) catalogDir = argv[++i];
+        else if (arg == "--from" && i + 1 < argc) fromText = argv[++i];
+        else if (arg == "--to" && i + 1 < argc) toText = argv[++i];
+        else if (arg == "--convert" && i + 1 < argc) convertTo = argv[++i];
+        else if (arg == "--hugepages") hugePages = true;
+        else filename = arg;
+    }
+    auto reportHugePages = [&] {
+        if (!hugePages) return;
+        std::cout << "Huge pages (THP " << HugePages::mode() << "): " << (HugePages::mapped() >> 20)
+                  << " MB of order arrays mapped, " << (HugePages::backed() >> 20)
+                  << " MB of the process backed by 2 MB pages" << std::endl;
+    };
+    try {
+        if (hugePages) HugePages::enable();
+        if (!convertTo.empty()) {
+            MappedFile file(filename);
+            file.willNeed(file.view());
+            OrderRows entries = OrderBook::loadOrders(file.view(), threads);
+            if (convertTo.size() > 4 && convertTo.compare(convertTo.size() - 4, 4, ".obz") == 0) {
+                ArchiveFile::write(convertTo, entries);
+            } else {
+                SnapshotFile::write(convertTo, entries);
+            }
+            std::cout << "Wrote " << convertTo << std::endl;
+            return 0;
+        }
+        Timestamp from = std::numeric_limits<Timestamp>::min();
+        Timestamp to = std::numeric_limits<Timestamp>::max();
+        if ((!fromText.empty() && !CSVReader::parseTimestamp(fromText, from)) ||
+            (!toText.empty() && !CSVReader::parseTimestamp(toText, to))) {
+            throw std::runtime_error("times must look like 2020/03/17 17:30:00[.000000]");
+        }
+        if (!toText.empty() && catalogDir.empty()) throw std::runtime_error("--to needs --catalog");
+        if (follow && !catalogDir.empty()) throw std::runtime_error("--follow cannot be used with --catalog");
+        if (!catalogDir.empty()) {
+            DatasetCatalog catalog(catalogDir);
+            std::vector<std::string> paths = catalog.filesFor(from, to);
+            std::cout << "Catalog: " << catalog.getFiles().size() << " files, replaying " << paths.size()
+                      << std::endl;
+            if (paths.empty()) throw std::runtime_error("no catalogued files cover that time range");
+            OrderBook book(std::make_unique<MergedStream>(paths, from, to), window > 0 ? window : 16);
+            reportHugePages();
+            MerkelMain app(std::move(book));
+            app.init();
+            return 0;
+        }
+        if (window > 0) {
+            MappedFile file(filename);
+            if (SnapshotFile::isSnapshot(file.view()) || ArchiveFile::isArchive(file.view())) {
+                throw std::runtime_error("only CSV datasets can be streamed");
+            }
+            uint64_t offset = fromText.empty() ? 0 : SeekIndex::seek(filename, from);
+            OrderBook book(std::make_unique<CSVStream>(filename, offset, follow), window);
+            reportHugePages();
+            MerkelMain app(std::move(book));
+            app.init();
+            return 0;
+        }
+        OrderBook book(filename, threads, follow, from);
+        reportHugePages();
+        MerkelMain app(std::move(book));
+        app.init();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
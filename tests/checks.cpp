@@ -0,0 +1,401 @@
+// Regression checks for the trading platform. Build and run from the repo root:
+//   g++ -o checks tests/checks.cpp -std=c++17 -pthread && ./checks
+// The program is compiled in with its entry point renamed.
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#define main trader_main
+#include "../main.cpp"
+#undef main
+
+static int failures = 0;
+
+// Every global allocation is counted, so a check can assert a stretch of
+// code allocates nothing. All forms of operator new and delete are
+// replaced so none pairs with the library's. The malloc and free behind
+// them stay out of line, or the compiler pairs them with delete and warns.
+static std::atomic<size_t> allocations{0};
+
+__attribute__((noinline)) static void* countedAlloc(size_t bytes, size_t alignment) {
+    ++allocations;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(bytes ? bytes : 1);
+    return std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+}
+
+__attribute__((noinline)) static void countedFree(void* p) { std::free(p); }
+
+void* operator new(size_t bytes) {
+    if (void* p = countedAlloc(bytes, 0)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t bytes, std::align_val_t align) {
+    if (void* p = countedAlloc(bytes, static_cast<size_t>(align))) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept { return countedAlloc(bytes, 0); }
+void* operator new(size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return countedAlloc(bytes, static_cast<size_t>(align));
+}
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(p); }
+
+static void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+    if (!ok) ++failures;
+}
+
+static std::string tempPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("trader-checks-" + name)).string();
+}
+
+static bool sameRows(const OrderRows& a, const OrderRows& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].timestamp != b[i].timestamp || a[i].product != b[i].product || a[i].orderType != b[i].orderType ||
+            a[i].price != b[i].price || a[i].amount != b[i].amount || a[i].account != b[i].account) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A CSV image of rows whose timestamps go back and forth and repeat, with a
+// malformed line now and then
+static std::string sampleCSV(size_t rows, unsigned seed) {
+    std::mt19937 rng(seed);
+    const char* products[] = {"ETH/BTC", "DOGE/BTC", "BTC/USDT"};
+    std::string csv;
+    for (size_t i = 0; i < rows; ++i) {
+        if (rng() % 1000 == 0) {
+            csv += "not,a,row\n";
+            continue;
+        }
+        Timestamp t = (i / 50 + rng() % 5) * 1000000 + 1584464484884492;
+        csv += CSVReader::formatTimestamp(t) + "," + products[rng() % 3] + (rng() % 2 ? ",bid," : ",ask,") +
+               "0.0" + std::to_string(rng() % 10000000) + "," + std::to_string(rng() % 100) + "." +
+               std::to_string(rng() % 1000) + "\n";
+    }
+    return csv;
+}
+
+// A followed CSV opened at its end must pick up a row appended before the
+// first poll on that very poll, not one poll later.
+static void followPicksUpAppendOnFirstPoll() {
+    std::string path = tempPath("follow.csv");
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "2020/03/17 17:01:24.884492,ETH/BTC,bid,0.02187308,7.44564869\n";
+    }
+    CSVStream stream(path, std::filesystem::file_size(path), true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // let the reader see end of file
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "2020/03/17 17:01:30.099017,ETH/BTC,bid,0.02187307,3.467434\n";
+    }
+    OrderRows rows;
+    bool got = stream.next(rows);
+    check(got && rows.size() == 1, "follow: row appended at end of file is read on the first poll");
+    std::filesystem::remove(path);
+}
+
+// User orders inserted in a batch come back by handle and in placement
+// order; cancelling one drops it everywhere and frees its slot for reuse.
+static void userOrdersInsertAndCancel() {
+    std::string path = tempPath("book.csv");
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "2020/03/17 17:01:24.884492,ETH/BTC,bid,0.02187308,7.44564869\n";
+    }
+    OrderBook book(path, 1);
+    ProductId eth = Symbols::product("ETH/BTC");
+    AccountId user = Accounts::id("checks");
+    Timestamp t1 = book.getEarliestTime(), t2 = t1 + 1000000;
+    OrderRows batch;
+    batch.emplace_back(Price::fromUnits(300), Quantity::fromUnits(1), t2, eth, OrderBookType::ask, user);
+    batch.emplace_back(Price::fromUnits(100), Quantity::fromUnits(1), t1, eth, OrderBookType::bid, user);
+    batch.emplace_back(Price::fromUnits(200), Quantity::fromUnits(1), t1, eth, OrderBookType::bid, user);
+    std::vector<OrderHandle> handles = book.insertOrders(batch);
+
+    bool found = handles.size() == 3;
+    for (size_t i = 0; found && i < handles.size(); ++i) {
+        const OrderBookEntry* e = book.findOrder(handles[i]);
+        found = e && e->price == batch[i].price && e->timestamp == batch[i].timestamp;
+    }
+    check(found, "insertOrders: each handle finds its own order");
+    auto bids = book.getUserOrders(OrderBookType::bid, eth, t1);
+    check(bids.size() == 2 && bids[0].price() == Price::fromUnits(100) && bids[1].price() == Price::fromUnits(200),
+          "insertOrders: orders sharing a timestamp keep batch order");
+
+    check(book.cancelOrder(handles[1]) && !book.findOrder(handles[1]) && !book.cancelOrder(handles[1]),
+          "cancelOrder: a cancelled handle stops resolving");
+    bids = book.getUserOrders(OrderBookType::bid, eth, t1);
+    check(bids.size() == 1 && bids[0].price() == Price::fromUnits(200), "cancelOrder: the order leaves its timestamp");
+
+    OrderHandle reused = book.insertOrder(batch[1]);
+    check(static_cast<uint32_t>(reused) == static_cast<uint32_t>(handles[1]) && reused != handles[1] &&
+              !book.findOrder(handles[1]),
+          "cancelOrder: the slot is reused under a new handle");
+
+    // cancelling in any order leaves exactly the other orders at the time
+    std::mt19937 rng(19);
+    OrderRows many;
+    for (int64_t i = 1; i <= 500; ++i) {
+        many.emplace_back(Price::fromUnits(i), Quantity::fromUnits(1), t2, eth, OrderBookType::ask, user);
+    }
+    std::vector<OrderHandle> live = book.insertOrders(many);
+    std::shuffle(live.begin(), live.end(), rng);
+    bool consistent = true;
+    while (!live.empty() && consistent) {
+        consistent = book.cancelOrder(live.back());
+        live.pop_back();
+        if (live.size() % 50 != 0) continue;
+        std::vector<int64_t> expected, listed;
+        for (OrderHandle h : live) expected.push_back(book.findOrder(h)->price.units());
+        for (OrderRef r : book.getUserOrders(OrderBookType::ask, eth, t2)) {
+            if (r.price() != Price::fromUnits(300)) listed.push_back(r.price().units());
+        }
+        std::sort(expected.begin(), expected.end());
+        std::sort(listed.begin(), listed.end());
+        consistent = consistent && expected == listed;
+    }
+    check(consistent, "cancelOrder: random cancels leave exactly the remaining orders listed");
+    std::filesystem::remove(path);
+}
+
+// Merging batches in any order must leave the rows as a stable sort of
+// everything added, by timestamp then product and side.
+static void mergeMatchesStableSort() {
+    std::mt19937 rng(17);
+    ProductId products[] = {Symbols::product("ETH/BTC"), Symbols::product("DOGE/BTC")};
+    auto row = [&](int64_t n) {
+        return OrderBookEntry(Price::fromUnits(n), Quantity::fromUnits(1), rng() % 20, products[rng() % 2],
+                              rng() % 2 ? OrderBookType::ask : OrderBookType::bid);
+    };
+    OrderStore store;
+    OrderRows all;
+    int64_t n = 0;
+    for (int round = 0; round < 50; ++round) {
+        OrderRows batch;
+        size_t count = rng() % 8;
+        for (size_t i = 0; i < count; ++i) batch.push_back(row(n++));
+        all.insert(all.end(), batch.begin(), batch.end());
+        store.merge(batch);
+    }
+    std::stable_sort(all.begin(), all.end(), [](const OrderBookEntry& a, const OrderBookEntry& b) {
+        if (a.timestamp != b.timestamp) return a.timestamp < b.timestamp;
+        if (a.product != b.product) return a.product < b.product;
+        return a.orderType < b.orderType;
+    });
+    bool same = store.size() == all.size();
+    for (size_t i = 0; same && i < all.size(); ++i) same = store.entry(i).price == all[i].price;
+    check(same, "merge: rows match a stable sort of all batches");
+}
+
+// Memory is released the way it was allocated, so huge pages cannot be
+// switched on once the allocator has handed anything out.
+static void hugePagesEnableOnlyBeforeAllocating() {
+    Column<Timestamp> column(16);
+    bool refused = false;
+    try {
+        HugePages::enable();
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    check(refused && !HugePages::enabled(), "huge pages: enabling after an allocation is refused");
+}
+
+// Splitting a large image across threads must not change the rows or
+// their order, ties included.
+static void threadedReadMatchesSingleThreaded() {
+    std::string csv = sampleCSV(200000, 3);
+    OrderRows one = CSVReader::readCSV(csv, 1);
+    OrderRows eight = CSVReader::readCSV(csv, 8);
+    check(!one.empty() && sameRows(one, eight), "readCSV: 8 threads give the same rows as 1");
+}
+
+// Days past the end of their month are rejected, leap years included
+static void timestampsRejectImpossibleDates() {
+    Timestamp t;
+    auto parses = [&](const char* s) { return CSVReader::parseTimestamp(s, t); };
+    check(!parses("2020/02/31 17:01:24.884492") && !parses("2019/02/29 00:00:00") &&
+              !parses("2020/04/31 00:00:00") && !parses("1900/02/29 00:00:00"),
+          "parseTimestamp: days past the end of the month are rejected");
+    check(parses("2020/02/29 00:00:00") && parses("2000/02/29 00:00:00") && parses("2020/12/31 23:59:59.999999"),
+          "parseTimestamp: last days of months are accepted");
+}
+
+// Prices and amounts convert exactly to 10^-8 units or are refused
+static void fixedPointEdgeCases() {
+    auto units = [](const char* field, int64_t expected) {
+        int64_t value = 0;
+        return CSVReader::parseFixed(field, value, 8) == std::errc() && value == expected;
+    };
+    auto fails = [](const char* field, std::errc expected) {
+        int64_t value = 0;
+        return CSVReader::parseFixed(field, value, 8) == expected;
+    };
+    check(units("0.00000078", 78) && units(".5", 50000000) && units("1.", 100000000) &&
+              units("2.500000000", 250000000) && units("-3.25", -325000000),
+          "parseFixed: exact decimals convert to units");
+    check(fails("0.000000001", std::errc::result_out_of_range), "parseFixed: a ninth non-zero decimal is refused");
+    check(fails("92233720368.54775808", std::errc::result_out_of_range) &&
+              fails("99999999999999999999", std::errc::result_out_of_range),
+          "parseFixed: values past int64 are refused");
+    check(units("92233720368.54775807", INT64_MAX), "parseFixed: the largest int64 value converts");
+    check(fails("-", std::errc::invalid_argument) && fails("+1", std::errc::invalid_argument) &&
+              fails("", std::errc::invalid_argument) && fails(".", std::errc::invalid_argument) &&
+              fails("1.2.3", std::errc::invalid_argument) && fails("1e5", std::errc::invalid_argument),
+          "parseFixed: anything but a plain decimal is refused");
+}
+
+// Runs the menu over input and returns what it printed
+static std::string runMenu(OrderBook book, const std::string& input) {
+    std::istringstream in(input);
+    std::ostringstream out;
+    std::streambuf* cinWas = std::cin.rdbuf(in.rdbuf());
+    std::streambuf* coutWas = std::cout.rdbuf(out.rdbuf());
+    MerkelMain app(std::move(book));
+    app.init();
+    std::cin.rdbuf(cinWas);
+    std::cout.rdbuf(coutWas);
+    std::cin.clear();
+    return out.str();
+}
+
+// A streamed book stays at its newest time once it runs out of rows.
+// Continuing there must not match and settle the same orders again.
+static void stepThatDoesNotAdvanceSettlesNothing() {
+    std::string path = tempPath("stream.csv");
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "2020/03/17 17:01:24.000000,ETH/BTC,ask,0.02,5\n"
+            << "2020/03/17 17:01:30.000000,ETH/BTC,ask,0.02,5\n";
+    }
+    // step to the last time, bid for 1 ETH there, then continue three times
+    std::string out = runMenu(OrderBook(std::make_unique<CSVStream>(path, 0, false), 2),
+                              "6\n4\nETH/BTC,0.03,1\n6\n6\n6\n5\n");
+    size_t eth = out.rfind("ETH : ");
+    check(eth != std::string::npos && out.compare(eth, 14, "ETH : 1.000000") == 0,
+          "stream: continuing at the last time settles a sale once");
+    std::filesystem::remove(path);
+}
+
+// Rows written to a .obk snapshot or a .obz archive read back unchanged
+static void binaryFormatsRoundTrip() {
+    OrderRows rows = CSVReader::readCSV(sampleCSV(50000, 8), 1);
+    std::string obk = tempPath("rows.obk"), obz = tempPath("rows.obz");
+    SnapshotFile::write(obk, rows);
+    ArchiveFile::write(obz, rows);
+    {
+        MappedFile file(obk);
+        check(SnapshotFile::isSnapshot(file.view()) && sameRows(SnapshotFile::read(file.view()), rows),
+              "snapshot: .obk rows read back unchanged");
+    }
+    {
+        MappedFile file(obz);
+        check(ArchiveFile::isArchive(file.view()) && sameRows(ArchiveFile::read(file.view()), rows),
+              "archive: .obz rows read back unchanged");
+    }
+    std::filesystem::remove(obk);
+    std::filesystem::remove(obz);
+}
+
+// Seeking through the sparse index lands on the same row as a scan from
+// the start, with CRLF line ends and blank lines in the file too
+static void seekMatchesLinearScan() {
+    for (const char* eol : {"\n", "\r\n"}) {
+        std::mt19937 rng(14);
+        std::string path = tempPath("seek.csv");
+        Timestamp first = 1584464484884492, t = first;
+        std::string csv;
+        for (size_t i = 0; i < 30000; ++i) {
+            if (rng() % 50 == 0) csv += eol;
+            t += rng() % 3 == 0 ? 0 : rng() % 2000000;
+            csv += CSVReader::formatTimestamp(t) + ",ETH/BTC,bid,0.02187308,7.44564869" + eol;
+        }
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << csv;
+        Timestamp last = t;
+
+        auto scan = [&](Timestamp target) {
+            size_t offset = 0;
+            while (offset < csv.size()) {
+                size_t nl = csv.find('\n', offset);
+                std::string_view line(csv.data() + offset, nl - offset);
+                Timestamp rowTime;
+                if (CSVReader::parseTimestamp(line.substr(0, line.find(',')), rowTime) && rowTime >= target) break;
+                offset = nl + 1;
+            }
+            return std::min(offset, csv.size());
+        };
+        bool same = true;
+        for (int pass = 0; pass < 2; ++pass) { // built, then loaded from the sidecar
+            for (int q = 0; q < 1000 && same; ++q) {
+                Timestamp target = first - 1000000 + static_cast<Timestamp>(rng() % (last - first + 2000000));
+                same = SeekIndex::seek(path, target) == scan(target);
+            }
+        }
+        same = same && SeekIndex::seek(path, first) == scan(first) && SeekIndex::seek(path, last) == scan(last);
+        check(same, std::string("seek: index agrees with a linear scan (") + (eol[0] == '\r' ? "CRLF" : "LF") + ")");
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".idx");
+    }
+}
+
+// Once the step arena has grown to the busiest step, stepping through the
+// replay (matching every product and moving to the next time) allocates
+// nothing from the heap.
+static void stepsAllocateNothingOnceWarm() {
+    std::string path = tempPath("steps.csv");
+    std::ofstream(path, std::ios::trunc) << sampleCSV(20000, 18);
+    OrderBook book(path, 1);
+    StepArena arena;
+    Timestamp first = book.getEarliestTime(), t = first;
+    auto step = [&] {
+        book.poll();
+        for (ProductId p : book.getKnownProducts()) book.matchAsksToBids(p, t, &arena);
+        t = book.getNextTime(t);
+        book.advanceTo(t);
+        arena.reset();
+    };
+    size_t steps = 0;
+    do {
+        step(); // the first lap grows the arena
+        ++steps;
+    } while (t != first);
+    size_t before = allocations;
+    for (size_t i = 0; i < steps; ++i) step();
+    size_t during = allocations - before;
+    check(steps > 100 && during == 0,
+          "arena: a lap of " + std::to_string(steps) + " steps made " + std::to_string(during) + " allocations");
+    std::filesystem::remove(path);
+}
+
+int main() {
+    threadedReadMatchesSingleThreaded();
+    timestampsRejectImpossibleDates();
+    fixedPointEdgeCases();
+    stepThatDoesNotAdvanceSettlesNothing();
+    binaryFormatsRoundTrip();
+    seekMatchesLinearScan();
+    stepsAllocateNothingOnceWarm();
+    followPicksUpAppendOnFirstPoll();
+    userOrdersInsertAndCancel();
+    mergeMatchesStableSort();
+    hugePagesEnableOnlyBeforeAllocating();
+    if (failures > 0) {
+        std::cout << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}